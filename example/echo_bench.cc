@@ -0,0 +1,175 @@
+/**
+ * io_uring完成式I/O引擎与epoll就绪式路径的对比测试
+ * 进程内起一个echo服务器(TcpServer::setIoEngine选择引擎)，另一个线程用epoll做ping-pong客户端：
+ * 每个连接先发一条size字节的消息，收齐回显后立即再发，统计每秒往返次数
+ *
+ * 用法：./echo_bench <epoll|uring> [连接数=64] [消息大小=64] [秒数=5] [subloop数=1]
+ * 两种引擎各跑一次对比；测试期间屏蔽了std::cout，INFO日志仍会格式化但不再输出
+ **/
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "TcpServer.h"
+#include "EventLoop.h"
+
+namespace
+{
+
+const uint16_t kPort = 9981;
+
+struct ClientResult
+{
+    bool ok = false;
+    double seconds = 0;
+    long roundTrips = 0;
+};
+
+ClientResult runClient(int conns, size_t size, double seconds)
+{
+    ClientResult result;
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<int> fds;
+    std::vector<size_t> received(conns, 0);
+    std::string message(size, 'x');
+    std::vector<char> readBuf(1 << 20);
+
+    for (int i = 0; i < conns; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr;
+        ::memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(kPort);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) < 0)
+        {
+            fprintf(stderr, "connect error:%d\n", errno);
+            ::close(fd);
+            break;
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = static_cast<uint32_t>(fds.size());
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        fds.push_back(fd);
+    }
+    if (static_cast<int>(fds.size()) == conns)
+    {
+        ::usleep(200 * 1000); // 等服务器建立好所有连接
+        for (int fd : fds)
+        {
+            ::write(fd, message.data(), message.size());
+        }
+
+        result.ok = true;
+        auto start = std::chrono::steady_clock::now();
+        auto end = start + std::chrono::duration<double>(seconds);
+        epoll_event events[256];
+        while (result.ok && std::chrono::steady_clock::now() < end)
+        {
+            int n = ::epoll_wait(epfd, events, 256, 100);
+            for (int k = 0; k < n; ++k)
+            {
+                uint32_t i = events[k].data.u32;
+                ssize_t r = ::read(fds[i], readBuf.data(), readBuf.size());
+                if (r <= 0)
+                {
+                    fprintf(stderr, "connection %u closed by server\n", i);
+                    result.ok = false;
+                    break;
+                }
+                received[i] += r;
+                while (received[i] >= size)
+                {
+                    received[i] -= size;
+                    ++result.roundTrips;
+                    size_t written = 0;
+                    while (written < size) // 消息不大 阻塞socket上一般一次写完
+                    {
+                        ssize_t w = ::write(fds[i], message.data() + written, size - written);
+                        if (w > 0)
+                        {
+                            written += w;
+                        }
+                    }
+                }
+            }
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    ::close(epfd);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || (strcmp(argv[1], "epoll") != 0 && strcmp(argv[1], "uring") != 0))
+    {
+        fprintf(stderr, "usage: %s <epoll|uring> [conns] [size] [seconds] [threads]\n", argv[0]);
+        return 1;
+    }
+    const bool uring = strcmp(argv[1], "uring") == 0;
+    const int conns = argc > 2 ? atoi(argv[2]) : 64;
+    const size_t size = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 64;
+    const double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+    const int threads = argc > 5 ? atoi(argv[5]) : 1;
+
+    std::cout.setstate(std::ios::badbit); // 屏蔽日志输出 否则测的主要是写日志的开销
+
+    EventLoop loop;
+    if (uring && loop.ioUring() == nullptr)
+    {
+        fprintf(stderr, "io_uring engine unavailable on this kernel\n");
+        return 1;
+    }
+    TcpServer server(&loop, InetAddress(kPort), "EchoBench");
+    if (uring)
+    {
+        server.setIoEngine(TcpServer::kIoUringEngine);
+    }
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf);
+    });
+    server.setThreadNum(threads);
+    server.start();
+
+    ClientResult result;
+    std::thread client([&] {
+        result = runClient(conns, size, seconds);
+        ::usleep(100 * 1000); // 让服务器处理完关闭
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+
+    if (!result.ok)
+    {
+        return 1;
+    }
+    printf("%-5s conns=%d size=%zu threads=%d: %.0f round trips/s, %.1f MB/s\n",
+           argv[1], conns, size, threads, result.roundTrips / result.seconds,
+           result.roundTrips * static_cast<double>(size) * 2 / result.seconds / 1e6);
+    return 0;
+}
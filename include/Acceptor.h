@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Socket.h"
@@ -8,6 +9,7 @@
 
 class EventLoop;
 class InetAddress;
+class IoUringEngine;
 
 /*
 acceptor专门负责监听服务器段的监听socket，当有新的客户端连接到来时，负责接收连接并将新连接的文件描述符
@@ -23,15 +25,23 @@ public:
 
     void setNewConnectionCallback(const NewConnectionCallback &cb) { NewConnectionCallback_ = cb; }
     bool listenning() const { return listenning_; } // 查询是否正在监听
+    EventLoop *getLoop() const { return loop_; }     // 所属事件循环
     void listen(); // 启动监听
+    // 用loop的IoUringEngine挂一个multishot accept代替等待可读事件 内核不支持时仍使用Poller 须在listen之前设置
+    void setUseIoUring(bool on) { useIoUring_ = on; }
 
 
 private:
     void handleRead(); // 处理新连接到来的事件
+    void armAccept();
+    void handleAcceptCompletion(int res, uint32_t flags);
 
     EventLoop *loop_;           // 事件循环对象指针
     Socket acceptSocket_;       // 用于监听新连接的 socket
     Channel acceptChannel_;     // 用于监听 socket 上的事件
     NewConnectionCallback NewConnectionCallback_; // 新连接到来时的回调函数
     bool listenning_;           // 标记是否正在监听
+    bool useIoUring_;           // 是否请求使用multishot accept
+    IoUringEngine *uring_;      // 非空时由它接受连接
+    uint64_t acceptRequest_;    // 挂着的multishot accept 0表示没有
 };
\ No newline at end of file
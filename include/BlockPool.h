@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+/**
+ * 固定大小内存块的对象池，每个EventLoop持有一个，只在所属loop线程中使用，因此无需加锁。
+ * ChainBuffer从这里取块、用完后还回来，空闲块最多缓存maxFreeBlocks个，多余的直接释放。
+ **/
+class BlockPool : noncopyable
+{
+public:
+    static const size_t kDefaultBlockSize = 16 * 1024;  // 每个内存块16KB
+    static const size_t kDefaultMaxFreeBlocks = 1024;   // 最多缓存1024个空闲块 即16MB
+
+    explicit BlockPool(size_t blockSize = kDefaultBlockSize,
+                       size_t maxFreeBlocks = kDefaultMaxFreeBlocks);
+    ~BlockPool();
+
+    char *allocate();               // 取出一个内存块，空闲链表为空时才向堆申请
+    void deallocate(char *block);   // 归还一个内存块
+
+    size_t blockSize() const { return blockSize_; }
+    size_t freeBlocks() const { return freeList_.size(); }  // 池中空闲块数量
+    size_t usedBlocks() const { return usedBlocks_; }       // 已借出、尚未归还的块数量
+
+private:
+    const size_t blockSize_;
+    const size_t maxFreeBlocks_;
+    size_t usedBlocks_;
+    std::vector<char *> freeList_;
+};
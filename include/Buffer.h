@@ -3,7 +3,64 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <assert.h>
+#include <endian.h>
+#include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "ByteSearch.h"
+
+/**
+ * 自适应接收时记录一个连接最近的读取量，用来预估下一次readv应该准备多大的空间
+ * 读满了预估空间就翻倍，连续两次读到不足一半就减半，在[kMinReadSize, kMaxReadSize]之间调整
+ **/
+class ReadSizer
+{
+public:
+    static constexpr size_t kMinReadSize = 64;
+    static constexpr size_t kInitialReadSize = 2048;
+    static constexpr size_t kMaxReadSize = 64 * 1024;
+    static constexpr size_t kFionreadThreshold = 16 * 1024; // 预估值达到该大小后才用FIONREAD精确查询
+
+    explicit ReadSizer(bool useFionread = false)
+        : expected_(kInitialReadSize)
+        , useFionread_(useFionread)
+        , smallReads_(0)
+    {
+    }
+
+    size_t expected() const { return expected_; }
+    bool useFionread() const { return useFionread_ && expected_ >= kFionreadThreshold; }
+
+    // n为本次实际读到的字节数 target为本次准备的空间大小
+    void update(size_t n, size_t target)
+    {
+        if (n >= target)
+        {
+            expected_ = std::min(expected_ * 2, kMaxReadSize);
+            smallReads_ = 0;
+        }
+        else if (n < expected_ / 2)
+        {
+            if (++smallReads_ >= 2)
+            {
+                expected_ = std::max(expected_ / 2, kMinReadSize);
+                smallReads_ = 0;
+            }
+        }
+        else
+        {
+            smallReads_ = 0;
+        }
+    }
+
+private:
+    size_t expected_;
+    bool useFionread_;
+    int smallReads_;
+};
 
 // 网络库底层的缓冲区类型定义
 class Buffer
@@ -16,12 +73,66 @@ public:
         : buffer_(kCheapPrepend + initalSize)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
+        , growthFactor_(1.0)
+    {
+    }
+
+    Buffer(const Buffer &) = default;
+    Buffer &operator=(const Buffer &) = default;
+    // 移动后源对象没有存储且为空 与存储被BufferPool收走后的状态相同
+    Buffer(Buffer &&other) noexcept
+        : buffer_(std::move(other.buffer_))
+        , readerIndex_(other.readerIndex_)
+        , writerIndex_(other.writerIndex_)
+        , growthFactor_(other.growthFactor_)
     {
+        other.buffer_.clear();
+        other.readerIndex_ = kCheapPrepend;
+        other.writerIndex_ = kCheapPrepend;
     }
+    Buffer &operator=(Buffer &&other) noexcept
+    {
+        if (this != &other)
+        {
+            buffer_ = std::move(other.buffer_);
+            readerIndex_ = other.readerIndex_;
+            writerIndex_ = other.writerIndex_;
+            growthFactor_ = other.growthFactor_;
+            other.buffer_.clear();
+            other.readerIndex_ = kCheapPrepend;
+            other.writerIndex_ = kCheapPrepend;
+        }
+        return *this;
+    }
+
+    // 扩容时至少扩到当前大小的factor倍 factor<=1时按需精确扩容
+    void setGrowthFactor(double factor) { growthFactor_ = factor; }
 
     size_t readableBytes() const { return writerIndex_ - readerIndex_; }
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    // 存储被BufferPool收走后buffer_为空 此时可写空间为0
+    size_t writableBytes() const { return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0; }
     size_t prependableBytes() const { return readerIndex_; }
+    size_t internalCapacity() const { return buffer_.capacity(); }
+    bool hasStorage() const { return !buffer_.empty(); }
+
+    // 把存储收缩到刚好容纳现有可读数据再加reserve字节 用于突发流量过后归还内存
+    void shrink(size_t reserve)
+    {
+        std::vector<char> storage(kCheapPrepend + readableBytes() + reserve);
+        std::copy(peek(), peek() + readableBytes(), storage.begin() + kCheapPrepend);
+        size_t readable = readableBytes();
+        buffer_.swap(storage);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = readerIndex_ + readable;
+    }
+
+    // 与外部交换底层存储 只能在没有可读数据时调用 供BufferPool借出/收回存储
+    void swapStorage(std::vector<char> &storage)
+    {
+        buffer_.swap(storage);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend;
+    }
 
     // 返回缓冲区中可读数据的起始地址
     const char *peek() const { return begin() + readerIndex_; }
@@ -42,6 +153,20 @@ public:
         writerIndex_ = kCheapPrepend;
     }
 
+    /**
+     * 在可读数据[peek(), beginWrite())中直接查找分隔符 不拷贝数据 找不到返回nullptr
+     * 带start的版本从start开始查找 start必须位于可读数据之内 用于跳过已经检查过的部分
+     **/
+    const char *findCRLF() const { return ByteSearch::findCRLF(peek(), beginWrite()); }
+    const char *findCRLF(const char *start) const { return ByteSearch::findCRLF(start, beginWrite()); }
+    const char *findEOL() const { return ByteSearch::findByte(peek(), beginWrite(), '\n'); }
+    const char *findEOL(const char *start) const { return ByteSearch::findByte(start, beginWrite(), '\n'); }
+    const char *findByte(char c) const { return ByteSearch::findByte(peek(), beginWrite(), c); }
+    const char *findByte(const char *start, char c) const { return ByteSearch::findByte(start, beginWrite(), c); }
+    // 查找chars中任意一个字节 chars以'\0'结尾
+    const char *findAny(const char *chars) const { return ByteSearch::findAny(peek(), beginWrite(), chars); }
+    const char *findAny(const char *start, const char *chars) const { return ByteSearch::findAny(start, beginWrite(), chars); }
+
     // 把onMessage函数上报的Buffer数据 转成string类型的数据返回
     std::string retrieveAllAsString() { return retrieveAsString(readableBytes()); }
     std::string retrieveAsString(size_t len)
@@ -70,15 +195,73 @@ public:
     char *beginWrite() { return begin() + writerIndex_; }
     const char *beginWrite() const { return begin() + writerIndex_; }
 
+    // 把[data, data+len]放到可读数据之前的prepend区 len不能超过prependableBytes()
+    // 常用于数据写完后再在前面补上长度头 不需要搬移已有数据
+    void prepend(const void *data, size_t len)
+    {
+        assert(len <= prependableBytes());
+        readerIndex_ -= len;
+        const char *d = static_cast<const char *>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+
+    // 以下整数读写接口都使用网络字节序
+    void appendInt64(int64_t x) { int64_t be = htobe64(x); append(reinterpret_cast<const char *>(&be), sizeof be); }
+    void appendInt32(int32_t x) { int32_t be = htobe32(x); append(reinterpret_cast<const char *>(&be), sizeof be); }
+    void appendInt16(int16_t x) { int16_t be = htobe16(x); append(reinterpret_cast<const char *>(&be), sizeof be); }
+    void appendInt8(int8_t x) { append(reinterpret_cast<const char *>(&x), sizeof x); }
+
+    void prependInt64(int64_t x) { int64_t be = htobe64(x); prepend(&be, sizeof be); }
+    void prependInt32(int32_t x) { int32_t be = htobe32(x); prepend(&be, sizeof be); }
+    void prependInt16(int16_t x) { int16_t be = htobe16(x); prepend(&be, sizeof be); }
+    void prependInt8(int8_t x) { prepend(&x, sizeof x); }
+
+    // peek不消费数据 调用前要保证readableBytes()足够
+    int64_t peekInt64() const
+    {
+        assert(readableBytes() >= sizeof(int64_t));
+        int64_t be;
+        ::memcpy(&be, peek(), sizeof be);
+        return be64toh(be);
+    }
+    int32_t peekInt32() const
+    {
+        assert(readableBytes() >= sizeof(int32_t));
+        int32_t be;
+        ::memcpy(&be, peek(), sizeof be);
+        return be32toh(be);
+    }
+    int16_t peekInt16() const
+    {
+        assert(readableBytes() >= sizeof(int16_t));
+        int16_t be;
+        ::memcpy(&be, peek(), sizeof be);
+        return be16toh(be);
+    }
+    int8_t peekInt8() const
+    {
+        assert(readableBytes() >= sizeof(int8_t));
+        return *peek();
+    }
+
+    // read = peek + retrieve
+    int64_t readInt64() { int64_t x = peekInt64(); retrieve(sizeof x); return x; }
+    int32_t readInt32() { int32_t x = peekInt32(); retrieve(sizeof x); return x; }
+    int16_t readInt16() { int16_t x = peekInt16(); retrieve(sizeof x); return x; }
+    int8_t readInt8() { int8_t x = peekInt8(); retrieve(sizeof x); return x; }
+
     // 从fd上读取数据
     ssize_t readFd(int fd, int *saveErrno);
+    // 自适应接收：按sizer预估的大小准备可写空间，溢出的部分先读进调用方提供的spill区再追加
+    // keepStorage为true时(存储借自BufferPool)不为预估值扩容，只用现有的可写空间，其余由spill区承接
+    ssize_t readFd(int fd, int *saveErrno, ReadSizer *sizer, char *spill, size_t spillSize, bool keepStorage = false);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int *saveErrno);
 
 private:
     // vector底层数组首元素的地址 也就是数组的起始地址
-    char *begin() { return &*buffer_.begin(); }
-    const char *begin() const { return &*buffer_.begin(); }
+    char *begin() { return buffer_.data(); }
+    const char *begin() const { return buffer_.data(); }
 
     void makeSpace(size_t len)
     {
@@ -88,7 +271,12 @@ private:
          **/
         if (writableBytes() + prependableBytes() < len + kCheapPrepend) // 也就是说 len > xxx前面剩余的空间 + writer的部分
         {
-            buffer_.resize(writerIndex_ + len);
+            size_t newSize = writerIndex_ + len;
+            if (growthFactor_ > 1.0)
+            {
+                newSize = std::max(newSize, static_cast<size_t>(buffer_.size() * growthFactor_));
+            }
+            buffer_.resize(newSize);
         }
         else // 这里说明 len <= xxx + writer 把reader搬到从xxx开始 使得xxx后面是一段连续空间
         {
@@ -106,4 +294,19 @@ private:
     std::vector<char> buffer_;
     size_t readerIndex_;
     size_t writerIndex_;
+    double growthFactor_;
+};
+
+/**
+ * 连接缓冲区的使用策略，由TcpServer统一设置给它的每个连接
+ * 启用了BufferPool时输出队列和输入缓冲区的初始大小由BufferPool决定，initial*Size不再生效
+ **/
+struct BufferPolicy
+{
+    size_t initialInputSize = Buffer::kInitialSize;  // 输入缓冲区初始大小 也是收缩后的基线大小
+    size_t initialOutputSize = Buffer::kInitialSize; // 输出缓冲区初始大小 也是收缩后的基线大小
+    double growthFactor = 1.0;                       // 扩容倍数 <=1时按需精确扩容
+    size_t maxInputSize = 0;                         // 单个连接输入缓冲区上限 0表示不限制
+    size_t maxOutputSize = 0;                        // 单个连接待发送数据上限 0表示不限制
+    int shrinkAfterIdleIterations = 0;               // 连接连续这么多轮loop没有读写后把缓冲区收缩回基线 0表示不收缩
 };
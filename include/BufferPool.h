@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "noncopyable.h"
+#include "Buffer.h"
+
+/**
+ * 每个EventLoop持有一个的Buffer存储池，只在所属loop线程中使用。
+ * 启用后TcpConnection的inputBuffer_和输出队列平时不持有任何存储，有数据要收发时才从池中借一块，
+ * readableBytes()降为0后立即归还，空闲的长连接因此不再各自占着2KB以上的堆内存。
+ *
+ * 池子只缓存大小恰好为storageSize的存储；借出期间因突发流量扩容过的存储归还时直接释放，计入trimmedBytes。
+ **/
+class BufferPool : noncopyable
+{
+public:
+    static const size_t kDefaultStorageSize = Buffer::kCheapPrepend + Buffer::kInitialSize;
+    static const size_t kDefaultMaxPooledBytes = 4 * 1024 * 1024; // 池中最多缓存4MB
+
+    explicit BufferPool(size_t storageSize = kDefaultStorageSize,
+                        size_t maxPooledBytes = kDefaultMaxPooledBytes);
+
+    // 给没有存储的Buffer借一块存储 已有存储时什么也不做
+    void acquire(Buffer *buf);
+    // Buffer中没有可读数据时收回它的存储 否则什么也不做
+    void release(Buffer *buf);
+
+    size_t pooledBytes() const { return pooledBytes_; }     // 当前缓存在池中的字节数
+    size_t borrowedBytes() const { return borrowedBytes_; } // 当前借出未还的字节数(按借出时的大小计)
+    size_t trimmedBytes() const { return trimmedBytes_; }   // 累计归还时被释放回系统的字节数
+
+private:
+    const size_t storageSize_;
+    const size_t maxPooledBytes_;
+    size_t pooledBytes_;
+    size_t borrowedBytes_;
+    size_t trimmedBytes_;
+    std::vector<std::vector<char>> freeList_;
+};
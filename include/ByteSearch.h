@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * 在[begin, end)内查找分隔符的向量化实现，供Buffer的findCRLF/findEOL/findByte/findAny使用
+ * x86-64上用SSE2实现，CPU支持AVX2时在第一次调用时切换到AVX2版本，其它平台退化为逐字节扫描
+ * 找不到时都返回nullptr
+ **/
+namespace ByteSearch
+{
+    static const size_t kMaxSetSize = 8;
+
+    // 查找单个字节 直接用memchr glibc已经按CPU做了向量化和运行时分派
+    const char *findByte(const char *begin, const char *end, char c);
+    // 查找"\r\n" 返回'\r'的位置
+    const char *findCRLF(const char *begin, const char *end);
+    // 查找set中任意一个字节 set以'\0'结尾 最多支持kMaxSetSize个字节 超过时逐字节查表
+    const char *findAny(const char *begin, const char *end, const char *set);
+}
@@ -3,17 +3,30 @@
 #include <memory>
 #include <functional>
 
+#include "Task.h"
+
 class Buffer;
+class ChainBuffer;
 class TcpConnection;
 class Timestamp;
+class Payload;
+class CachedFile;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
-using TimerCallback = std::function<void()>;
+using PayloadPtr = std::shared_ptr<const Payload>;
+using CachedFilePtr = std::shared_ptr<const CachedFile>;
+using TimerCallback = Task;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+using BufferOverflowCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr &,
                                            Buffer *,
-                                           Timestamp)>;
\ No newline at end of file
+                                           Timestamp)>;
+
+// 输入缓冲区使用ChainBuffer时的消息回调
+using ChainMessageCallback = std::function<void(const TcpConnectionPtr &,
+                                                ChainBuffer *,
+                                                Timestamp)>;
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "noncopyable.h"
+
+class BlockPool;
+
+/**
+ * 由固定大小内存块串起来的链式缓冲区，内存块来自所属EventLoop的BlockPool
+ *
+ * | block0: 已读 | 可读 | -> | block1: 可读 | -> | block2: 可读 | 可写 |
+ *
+ * 和Buffer不同，追加数据时只会在链表尾部挂新块，已有数据永远不会被搬移或扩容拷贝；
+ * readFd用readv直接分散读进空闲块，writeFd用writev把多个块聚合写出。
+ * 代价是可读数据不保证连续，需要连续视图时使用retrieveAsString拷贝出来。
+ **/
+class ChainBuffer : noncopyable
+{
+public:
+    static const int kMaxIovecs = 64;         // writeFd一次writev最多聚合的块数
+    static const size_t kReadBlocks = 4;      // readFd时最多额外准备的空闲块数
+
+    explicit ChainBuffer(BlockPool *pool);
+    ~ChainBuffer();
+
+    size_t readableBytes() const { return readable_; }
+
+    // 第一个块中连续可读数据的起始地址和长度
+    const char *peek() const;
+    size_t peekableBytes() const;
+
+    void retrieve(size_t len);
+    void retrieveAll();
+    std::string retrieveAllAsString() { return retrieveAsString(readableBytes()); }
+    std::string retrieveAsString(size_t len);
+
+    // 把[data, data+len]追加到链表尾部 空间不够时挂新块
+    void append(const char *data, size_t len);
+
+    // 从可读数据第offset个字节开始，用最多maxIov个iovec描述不超过len字节的数据 返回实际使用的iovec个数
+    int peekIovecs(size_t offset, size_t len, struct iovec *iov, int maxIov) const;
+
+    // 从fd上读取数据
+    ssize_t readFd(int fd, int *saveErrno);
+    // 通过fd发送数据 不会移动读指针 调用者根据返回值retrieve
+    ssize_t writeFd(int fd, int *saveErrno);
+
+    // 把所有块还给BlockPool 必须在所属loop线程中调用
+    void releaseAll();
+
+private:
+    struct Block
+    {
+        char *data;
+        size_t readIndex;
+        size_t writeIndex;
+    };
+
+    size_t blockSize() const;
+
+    BlockPool *pool_;
+    std::deque<Block> blocks_;
+    size_t readable_;
+};
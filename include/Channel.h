@@ -32,6 +32,8 @@ public:
     void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
     void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
     void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+    // 设置后关注事件的变化不再交给Poller，而是调用cb，由完成式I/O引擎据此挂上或取消请求 remove()不再做任何事
+    void setUpdateCallback(EventCallback cb) { updateCallback_ = std::move(cb); }
 
     // 防止回调过程中对象被销毁
     void tie(const std::shared_ptr<void> &);
@@ -46,6 +48,9 @@ public:
     void enableWriting() { events_ |= kWriteEvent; update(); }
     void disableWriting() { events_ &= ~kWriteEvent; update(); }
     void disableAll() { events_ = kNoneEvent; update(); }
+    // 以EPOLLET注册 已经注册过时立即生效
+    void setEdgeTriggered(bool on);
+    bool edgeTriggered() const { return edgeTriggered_; }
 
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent; }
@@ -72,6 +77,7 @@ private:
     int events_;                   // 当前关注的事件类型
     int revents_;                  // 实际发生的事件类型，由 Poller 设置
     int index_;                    // 在 Poller 中的索引
+    bool edgeTriggered_;           // 是否边沿触发
 
     std::weak_ptr<void> tie_;      // 绑定的对象，防止回调时对象被销毁
     bool tied_;                    // 标记是否已绑定对象
@@ -81,4 +87,5 @@ private:
     EventCallback writeCallback_;
     EventCallback closeCallback_;
     EventCallback errorCallback_;
+    EventCallback updateCallback_;
 };
\ No newline at end of file
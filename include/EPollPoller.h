@@ -18,19 +18,43 @@ public:
     Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
     void updateChannel(Channel *channel) override;
     void removeChannel(Channel *channel) override;
+    bool setBusyPoll(uint32_t usecs, uint16_t budget, bool prefer) override;
 
 private:
     static const int kInitEventListSize = 16;   // 初始化 epoll 事件列表的容量
+    static const size_t kMaxEventListSize = 64 * 1024; // 事件列表容量上限
+    static const int kShrinkAfterPolls = 64;    // 连续多少次低使用率后缩小事件列表
 
     // 将 epoll_wait 检测到的活跃事件填充到 activeChannels 列表
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+    // 按本次就绪数扩大或缩小事件列表
+    void adjustEventList(int numEvents);
     // 封装 epoll_ctl 操作，更新 Channel 的事件类型
     void update(int operation, Channel *channel);
+    // 在epoll_wait之前一次性提交本轮积攒的EPOLL_CTL_MOD 水平触发且最终与内核中相同的跳过
+    void flushChanges();
+    uint32_t wantedEvents(Channel *channel) const;
 
     using EventList = std::vector<epoll_event>; // 定义 epoll_event 的集合类型
 
     int epollfd_;      // epoll 实例的文件描述符，由 epoll_create 创建
     EventList events_; // 存储 epoll_wait 检测到的所有事件
+    int lowUsagePolls_; // 连续低使用率的poll次数
+
+    /**
+     * 已注册的Channel修改关注事件时不立即epoll_ctl，只记下fd，等到下次epoll_wait之前统一提交
+     * 部分写时enableWriting/disableWriting经常在同一轮里来回切换，合并后多数修改净效果为空，不需要系统调用
+     * 修改只是推迟到poll之前，在那之前内核不会上报事件，所以水平触发的Channel不会漏掉或多报事件；
+     * 边沿触发的Channel不能跳过：EPOLL_CTL_MOD会按当前状态重新上报就绪，预算用完后暂停又恢复读的连接靠它读到剩下的数据
+     * ADD和DEL仍然立即执行：DEL之后fd可能马上被关闭、复用
+     **/
+    struct Interest
+    {
+        uint32_t registered = 0; // 内核中的关注事件(含EPOLLET)
+        bool dirty = false;      // 在changedFds_中等待提交
+    };
+    std::vector<Interest> interests_; // 下标为fd
+    std::vector<int> changedFds_;       // 有待提交修改的fd 可能有已经DEL的
 };
 
 /*
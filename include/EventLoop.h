@@ -4,22 +4,51 @@
 #include <vector>
 #include <atomic>
 #include <memory>
-#include <mutex>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "MpscQueue.h"
+#include "Task.h"
+#include "TimerId.h"
+#include "Callbacks.h"
 
 class Channel;
 class Poller;
+class BlockPool;
+class BufferPool;
+class PipePool;
+class ZeroCopyReaper;
+class IoUringEngine;
+class TimerQueue;
+class TimingWheel;
+
+/**
+ * 忙轮询策略，由EventLoop::setBusyPoll设置
+ * 阻塞进epoll_wait之前先用0超时的poll自旋一段时间，事件在自旋期间到达就省掉一次睡眠和唤醒的调度延迟，代价是占满一个核
+ * adaptive时按halt-polling的思路调整自旋时间：阻塞后很快就等到了事件说明再多自旋一会就能接住，自旋时间加倍；
+ * 阻塞了比maxSpinUs还久说明事件稀疏，自旋时间减半，直到为0
+ **/
+struct BusyPollPolicy
+{
+    int64_t maxSpinUs = 50;            // 每次阻塞前最多自旋的微秒数 0表示不自旋
+    bool adaptive = true;              // 在[0, maxSpinUs]内自适应调整 false时固定自旋maxSpinUs
+    uint32_t kernelBusyPollUs = 0;     // >0时用EPIOCSPARAMS开启内核epoll忙轮询(Linux 6.9+) 在网卡队列上轮询
+    uint16_t kernelBudget = 8;         // 内核每次忙轮询最多处理的包数 超过NAPI_POLL_WEIGHT需要CAP_NET_ADMIN
+    bool kernelPreferBusyPoll = false; // 配合网卡的napi_defer_hard_irqs/gro_flush_timeout减少中断
+};
 
 // 事件循环类 主要包含了两个大模块 Channel Poller(epoll的抽象)
 class EventLoop : noncopyable
 {
 public:
-    using Functor = std::function<void()>;
+    using Functor = Task; // 只能移动 小的回调对象内联保存 不分配内存
+    using IterationCheck = std::function<bool()>; // 返回false表示不再需要检查
     using ChannelList = std::vector<Channel*>;
 
+    static const size_t kRecvSpillSize = 64 * 1024;
+
     EventLoop();
     ~EventLoop();
 
@@ -31,13 +60,59 @@ public:
 
     void runInLoop(Functor cb);     // 在当前时间循环线程中立即执行回调
     void queueInLoop(Functor cb);   // 将回调函数加入队列，稍后在事件循环线程中执行
+    // 队列中的回调达到上限时返回false且不入队 由调用者决定丢弃、重试还是降级 未设置上限时等同queueInLoop
+    bool tryQueueInLoop(Functor cb);
+    // 设置tryQueueInLoop的上限 0表示不限制 上限是软限制 并发入队时可能略微超出
+    void setPendingFunctorLimit(size_t limit) { pendingFunctorLimit_ = limit; }
+    size_t pendingFunctorCount() const { return pendingFunctors_.size(); }
 
     void wakeup();  // 通过eventfd唤醒事件循环线程，防止长时间阻塞
 
+    struct BusyPollStats
+    {
+        uint64_t spinHits = 0;   // 自旋期间等到事件的次数
+        uint64_t spinMisses = 0; // 自旋结束仍没有事件、进入阻塞的次数
+        int64_t spinUs = 0;      // 当前的自旋时间
+    };
+    /**
+     * 开启忙轮询 见BusyPollPolicy；maxSpinUs和kernelBusyPollUs都为0时关闭
+     * 只能在loop线程中调用，线程池中的loop可以在TcpServer::setThreadInitCallback的回调里设置
+     * 自旋需要独占CPU，只有一个CPU在线时不开启自旋；内核忙轮询设置失败(内核不支持或权限不足)时记录错误；这两种情况返回false，其余设置照常生效
+     **/
+    bool setBusyPoll(const BusyPollPolicy &policy);
+    const BusyPollStats &busyPollStats() const { return busyPollStats_; }
+
+    /**
+     * 定时器 可以在任意线程调用 时间单位是秒
+     * slack是允许的最大延迟：到期时间按slack向后对齐，同一个对齐区间内的定时器只设置一次timerfd、只唤醒一次loop
+     * 大量连接级别的超时(空闲检测、请求超时)精度要求不高，给几十毫秒的slack就能把唤醒次数降几个数量级
+     **/
+    TimerId runAt(Timestamp time, TimerCallback cb, double slack = 0.0);
+    TimerId runAfter(double delay, TimerCallback cb, double slack = 0.0);
+    TimerId runEvery(double interval, TimerCallback cb, double slack = 0.0);
+    void cancel(TimerId timerId);
+    // 本loop的时间轮 tick为TimingWheel::kDefaultTick 用于大量只需要tick精度、频繁重新设置的连接超时
+    TimingWheel *timingWheel() { return timingWheel_.get(); }
+
+    uint64_t iteration() const { return iteration_; } // 事件循环已经执行的轮数
+    // 登记一个在每轮循环末尾(doPendingFunctors之后)执行的检查，返回false后自动移除；只能在loop线程中调用
+    // 在检查执行过程中或loop()之前登记的检查下一轮才执行，此时会唤醒loop，不会因poll阻塞而被推迟
+    void addIterationCheck(IterationCheck check);
+
     void updateChannel(Channel *channel); // 更新 Channel 的关注事件
     void removeChannel(Channel *channel); // 移除 Channel，不再监听
     bool hasChannel(Channel *channel);    // 检查 Channel 是否已被管理
 
+    BlockPool *blockPool() { return blockPool_.get(); }    // 本loop的内存块池，供ChainBuffer使用
+    BufferPool *bufferPool() { return bufferPool_.get(); } // 本loop的Buffer存储池，供TcpConnection借还缓冲区存储
+    PipePool *pipePool() { return pipePool_.get(); }       // 本loop的管道池，供splice转发使用
+    ZeroCopyReaper *zeroCopyReaper() { return zeroCopyReaper_.get(); } // 接管已销毁连接还没完成的零拷贝发送
+    // 本loop的io_uring完成式I/O引擎，第一次调用时创建；内核不支持时返回nullptr 只能在loop线程中调用
+    IoUringEngine *ioUring();
+    // 本loop所有连接共用的接收溢出区，自适应接收时代替Buffer::readFd里每次都要开的64KB栈数组
+    char *recvSpill() { return recvSpill_.data(); }
+    size_t recvSpillSize() const { return recvSpill_.size(); }
+
     // 判断当前代码是否运行在事件循环所属线程，保证线程安全
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
     void assertInLoopThread()
@@ -51,6 +126,9 @@ private:
     void abortNotInLoopThread();
     void handleRead();        // 处理 eventfd 读事件，响应唤醒操作
     void doPendingFunctors(); // 执行队列中的所有待处理回调
+    void doIterationChecks(); // 执行每轮循环末尾的检查
+    bool spinPoll();          // 忙轮询 自旋期间等到事件或回调时返回true
+    void adaptSpin(int64_t blockedUs);
 
     std::atomic_bool looping_; // 标记事件循环是否正在运行
     std::atomic_bool quit_;    // 标记是否请求退出事件循环
@@ -62,10 +140,31 @@ private:
 
     int wakeupFd_; // 作用：当mainLoop获取一个新用户的Channel 需通过轮询算法选择一个subLoop 通过该成员唤醒subLoop处理Channel
     std::unique_ptr<Channel> wakeupChannel_;
+    std::unique_ptr<TimerQueue> timerQueue_; // 本loop的所有定时器共用一个timerfd
+    std::unique_ptr<TimingWheel> timingWheel_; // 由timerQueue_驱动 必须在它之前析构
 
     ChannelList activeChannels_; // 返回Poller检测到当前有事件发生的所有Channel列表
 
-    std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作
-    std::mutex mutex_;                        // 互斥锁 用来保护上面vector容器的线程安全操作
+    std::unique_ptr<BlockPool> blockPool_;   // 只在本loop线程中使用的内存块池
+    std::unique_ptr<BufferPool> bufferPool_; // 只在本loop线程中使用的Buffer存储池
+    std::unique_ptr<PipePool> pipePool_;     // 只在本loop线程中使用的管道池
+    std::unique_ptr<ZeroCopyReaper> zeroCopyReaper_; // 持有Channel 在poller_之前析构
+    std::vector<char> recvSpill_;            // 接收溢出区 同一时刻只有一个连接在读 可以复用
+
+    MpscQueue<Functor> pendingFunctors_;         // 存储loop需要执行的所有回调操作 其它线程无锁入队
+    std::atomic<size_t> pendingFunctorLimit_;    // tryQueueInLoop的上限 0表示不限制
+    std::atomic_bool polling_;                   // loop线程即将或正在阻塞在poll中
+    std::atomic_bool wakeupPending_;             // 已经写过eventfd且loop还没处理 避免重复写
+
+    bool busyPoll_;                // 是否在阻塞前自旋
+    bool kernelBusyPoll_;          // 是否开启了内核epoll忙轮询
+    BusyPollPolicy busyPollPolicy_;
+    BusyPollStats busyPollStats_;  // spinUs即当前自旋时间
+
+    uint64_t iteration_;                          // 事件循环已经执行的轮数
+    std::vector<IterationCheck> iterationChecks_; // 每轮循环末尾执行的检查 只在loop线程中访问
+    bool callingIterationChecks_;                 // 是否正在执行每轮末尾的检查
+
+    bool ioUringTried_;                           // 是否已经尝试创建过ioUring_
+    std::unique_ptr<IoUringEngine> ioUring_;      // 最先析构 它注销ring fd时poller_还在
 };
\ No newline at end of file
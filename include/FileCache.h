@@ -0,0 +1,101 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+class Channel;
+class EventLoop;
+
+/**
+ * FileCache中的一个文件，打开后内容和大小不再变化(文件被修改时由FileCache作废并重新打开)
+ * 小文件整个mmap进来，关闭fd，通过writev和其它数据一起发送；其它文件保持fd打开，通过sendfile发送
+ * 发送期间连接持有CachedFilePtr，即使条目已被淘汰，fd和映射也要等发送完才释放
+ **/
+class CachedFile : noncopyable
+{
+public:
+    CachedFile(int fd, size_t size, void *map);
+    ~CachedFile();
+
+    int fd() const { return fd_; }   // mmap过的文件为-1
+    size_t size() const { return size_; }
+    bool mapped() const { return map_ != nullptr; }
+    const char *data() const { return static_cast<const char *>(map_); }
+
+private:
+    const int fd_;
+    const size_t size_;
+    void *const map_;
+};
+
+/**
+ * 进程级的静态文件缓存，多个loop线程可以共享同一个实例
+ * 命中时不再有open/fstat/close，只加一次锁；按LRU淘汰，同时限制缓存的文件个数(也就限制了打开的fd个数)和mmap的总字节数
+ * 调用enableInotify后通过inotify监视缓存中的文件，文件被修改、删除或移动时作废对应条目
+ *
+ * 用法：
+ *   CachedFilePtr file = cache.get(path);
+ *   if (file) conn->sendFile(file, header);
+ **/
+class FileCache : noncopyable
+{
+public:
+    static const size_t kDefaultMaxFiles = 1024;
+    static const size_t kDefaultMaxMappedBytes = 64 * 1024 * 1024;
+    static const size_t kDefaultMmapThreshold = 64 * 1024;
+
+    explicit FileCache(size_t maxFiles = kDefaultMaxFiles,
+                       size_t maxMappedBytes = kDefaultMaxMappedBytes,
+                       size_t mmapThreshold = kDefaultMmapThreshold);
+    // 启用了inotify时须在loop线程中析构
+    ~FileCache();
+
+    // 打开失败或不是普通文件时返回空
+    CachedFilePtr get(const std::string &path);
+    void invalidate(const std::string &path);
+    void clear();
+
+    // 在loop中监听inotify事件 须在loop线程中调用 缓存已被其它loop使用时也可以调用
+    bool enableInotify(EventLoop *loop);
+
+    size_t size() const;
+    size_t mappedBytes() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry
+    {
+        CachedFilePtr file;
+        std::list<std::string>::iterator lru;
+        int wd; // inotify watch 未启用时为-1
+    };
+
+    CachedFilePtr open(const std::string &path) const;
+    void eraseLocked(std::unordered_map<std::string, Entry>::iterator it);
+    void handleInotify();
+
+    const size_t maxFiles_;
+    const size_t maxMappedBytes_;
+    const size_t mmapThreshold_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<std::string> lru_;                       // 最近使用的在前
+    std::unordered_multimap<int, std::string> watches_; // wd => path 硬链接的多个路径可能共用一个wd
+    size_t mappedBytes_;
+    uint64_t hits_;
+    uint64_t misses_;
+
+    int inotifyFd_; // 只由enableInotify设置一次 其它线程在mutex_下读取
+    std::unique_ptr<Channel> inotifyChannel_;
+};
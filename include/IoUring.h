@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#include "noncopyable.h"
+
+/**
+ * io_uring实例的薄封装：创建并映射提交队列和完成队列，填写提交项，提交与等待，收割完成项
+ * IoUringPoller和IoUringEngine共用；不依赖liburing，直接使用io_uring_setup/io_uring_enter/io_uring_register系统调用
+ * 只能在一个线程中使用
+ **/
+class IoUring : noncopyable
+{
+public:
+    IoUring(unsigned sqEntries, unsigned cqEntries);
+    ~IoUring();
+
+    // io_uring_setup失败或内核缺少IORING_FEAT_EXT_ARG/NODROP(5.11)时为false
+    bool valid() const { return ringFd_ >= 0; }
+    int fd() const { return ringFd_; }
+    // 解除映射并关闭ring 析构时也会调用 可以重复调用
+    void close();
+
+    // 返回清零的提交项 提交队列满时先提交一次
+    io_uring_sqe *getSqe();
+    unsigned pendingSubmissions() const { return sqeTail_ - *sqTail_; }
+    // 提交积攒的提交项 waitNr>0时最多等待timeoutMs毫秒(小于0时一直等) 返回值和errno同io_uring_enter
+    int enter(unsigned waitNr, int timeoutMs);
+    int registerOp(unsigned opcode, void *arg, unsigned nrArgs);
+
+    bool hasCompletions() const { return __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE) != *cqHead_; }
+    // 对每个已到达的完成项调用handler(const io_uring_cqe &) 返回处理的个数
+    template <typename Handler>
+    unsigned reap(Handler &&handler)
+    {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        unsigned count = tail - head;
+        for (; head != tail; ++head)
+        {
+            handler(cqes_[head & cqMask_]);
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    bool setup(unsigned sqEntries, unsigned cqEntries);
+
+    int ringFd_;
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;             // 内核支持IORING_FEAT_SINGLE_MMAP时与sqRing_相同
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned *sqArray_;
+    unsigned sqeTail_;         // 已填好但还没提交的提交项的尾部 提交时写入*sqTail_
+
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Task.h"
+#include "IoUring.h"
+
+class EventLoop;
+class Channel;
+struct msghdr;
+
+/**
+ * 每个loop一个的io_uring完成式(proactor)I/O引擎，由EventLoop::ioUring()按需创建，
+ * 供TcpServer::setIoEngine(TcpServer::kIoUringEngine)的连接和Acceptor使用：
+ *   - 接收：每个连接挂一个multishot recv，内核从共享缓冲区环里挑缓冲区直接把数据放进去，
+ *     之后每段数据只产生一个完成项，不需要每次read的系统调用，也不用像readFd那样猜这次读多少
+ *   - 发送：一次sendmsg聚合输出队列队首的若干段
+ *   - 接受连接：监听socket挂一个multishot accept
+ * 本轮循环产生的提交项在doIterationChecks中用一次io_uring_enter提交；
+ * ring fd作为一个Channel注册在loop的Poller上，有完成项时可读，在读回调中收割完成项并分发给各请求的回调，
+ * 所以loop使用EPollPoller或IoUringPoller都可以
+ * 只能在所属loop线程中使用
+ **/
+class IoUringEngine : noncopyable
+{
+public:
+    // 参数即完成项的res和flags flags带IORING_CQE_F_MORE表示这个请求之后还会有完成项
+    using Callback = std::function<void(int res, uint32_t flags)>;
+    using RequestId = uint64_t; // 0表示无效
+
+    static const unsigned kBufferCount = 256;    // 接收缓冲区个数 必须是2的幂
+    static const size_t kBufferSize = 16 * 1024; // 每个接收缓冲区的大小
+
+    struct Stats
+    {
+        uint64_t submits = 0;     // io_uring_enter次数
+        uint64_t completions = 0; // 收到的完成项数
+        uint64_t noBuffers = 0;   // 接收缓冲区用光(-ENOBUFS)的次数
+    };
+
+    explicit IoUringEngine(EventLoop *loop);
+    ~IoUringEngine();
+
+    // 内核不支持io_uring或共享缓冲区环(5.19+)时为false
+    bool valid() const { return valid_; }
+
+    RequestId recvMultishot(int fd, Callback cb);
+    RequestId acceptMultishot(int fd, Callback cb);
+    // msg和它指向的iovec、数据在完成之前必须保持有效
+    RequestId sendmsg(int fd, const struct msghdr *msg, Callback cb);
+    // 一次性poll 完成项的res是发生的事件
+    RequestId pollAdd(int fd, uint32_t events, Callback cb);
+    /**
+     * 取消请求 请求真正结束(最后一个完成项，一般是-ECANCELED)之前回调照常执行
+     * discard为true时之后的完成项不再回调，用于回调引用的对象即将析构；这些完成项带的接收缓冲区自动归还
+     **/
+    void cancel(RequestId id, bool discard = false);
+
+    // 接收完成项的flags中带的缓冲区 数据取走后必须recycleBuffer归还
+    static uint16_t bufferId(uint32_t flags) { return static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT); }
+    const char *bufferData(uint16_t bid) const { return buffers_.get() + static_cast<size_t>(bid) * kBufferSize; }
+    void recycleBuffer(uint16_t bid);
+
+    // 在本轮提交之前执行 连接用它把本轮追加到输出队列的数据合并成一次sendmsg
+    void runBeforeSubmit(Task cb);
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    static const unsigned kSqEntries = 1024;
+    static const unsigned kCqEntries = 16384;   // 每个连接的multishot recv在一轮中可能产生多个完成项
+    static const uint16_t kBufferGroup = 0;
+    static const uint64_t kInternalTag = 0;     // 取消请求的user_data 请求的user_data不会为0
+    static const int kMaxSubmitRounds = 4;      // 每轮循环末尾最多连续提交并收割的次数
+    static const int kDrainRounds = 10;         // 析构时等待请求结束的最多次数
+    static const int kDrainWaitMs = 100;        // 析构时每次等待的毫秒数
+
+    struct Request
+    {
+        Callback callback;
+        uint32_t generation = 1; // 每次释放加一 与下标一起组成user_data
+        bool active = false;
+        bool discarded = false;
+    };
+
+    bool setupBuffers();
+    // 取消所有请求并丢弃完成项 等它们全部结束 超时返回false
+    bool drainRequests();
+    RequestId prepare(io_uring_sqe **sqe, Callback cb);
+    void release(uint32_t index);
+    void scheduleSubmit();
+    void submit();
+    void handleCompletions();
+    void dispatch(const io_uring_cqe &cqe);
+
+    EventLoop *loop_;
+    IoUring ring_;
+    bool valid_;
+    std::unique_ptr<Channel> ringChannel_;
+
+    // 与内核共享的缓冲区环 mmap的匿名内存；环尾与bufRing_[0].resv重叠
+    // 不用io_uring_buf_ring：它的bufs是C的柔性数组 按C++编译时偏移不是0
+    io_uring_buf *bufRing_;
+    size_t bufRingSize_;
+    uint16_t bufTail_;
+    std::unique_ptr<char[]> buffers_; // kBufferCount * kBufferSize的接收缓冲区
+
+    std::deque<Request> requests_;   // 回调执行中可能新增请求 deque扩容不移动已有元素
+    std::vector<uint32_t> freeRequests_;
+    std::vector<Task> beforeSubmit_;
+    bool submitScheduled_;
+    Stats stats_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "Poller.h"
+#include "Timestamp.h"
+#include "IoUring.h"
+
+class Channel;
+
+/**
+ * 基于io_uring的Poller，设置环境变量MUDUO_USE_IOURING时由Poller::newDefaultPoller创建，内核不支持时退回EPollPoller
+ * 关注事件的修改不调用epoll_ctl，而是写成IORING_OP_POLL_ADD/POLL_REMOVE提交项，和等待一起在一次io_uring_enter中提交
+ * 每轮循环只有一次系统调用
+ * io_uring的多次触发(multishot)poll只在fd被唤醒时产生完成项，语义与EPOLLET相同：
+ * 边沿触发的Channel使用multishot，挂一次一直有效；
+ * 水平触发的Channel使用一次性poll，每次完成后在下一次poll时重新挂上，仍然就绪会立即完成，与epoll水平触发一致
+ **/
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    bool valid() const { return ring_.valid(); } // io_uring_setup失败或内核缺少需要的特性时为false
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+private:
+    static const unsigned kSqEntries = 1024;
+    static const unsigned kCqEntries = 8192;   // 多次触发的poll可能在一轮中产生多个完成项
+    static const uint64_t kRemoveTag = 0;      // POLL_REMOVE的user_data POLL_ADD的user_data不会为0
+
+    struct Watch
+    {
+        uint64_t userData = 0;     // 当前挂着的POLL_ADD请求 高32位是序号 低32位是fd 0表示没有
+        uint32_t armedEvents = 0;  // 当前请求关注的事件
+        bool multishot = false;
+        bool dirty = false;        // 在changedFds_中等待提交
+        int revents = 0;           // 本次poll收到的事件 同一个fd的多个完成项合并为一次
+    };
+
+    Watch &watchOf(int fd);
+    void markDirty(int fd);
+    void flushChanges();
+    void arm(int fd, Channel *channel);
+    void disarm(int fd);
+    void reapCompletions(ChannelList *activeChannels);
+
+    IoUring ring_;
+    uint32_t nextSeq_;                // 区分同一个fd先后挂上的请求 旧请求的完成项直接丢弃
+    std::vector<Watch> watches_;      // 下标为fd
+    std::vector<int> changedFds_;     // 关注事件有变化或需要重新挂上的fd 可能有已经移除的
+    std::vector<int> activeFds_;      // 本次poll有事件的fd
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+class Buffer;
+
+/**
+ * 长度头分帧编解码器：每帧前面是4字节网络字节序的帧长度(不含长度头本身)
+ *
+ * 收：把onMessage设置为TcpServer的MessageCallback，凑齐一整帧后以std::string_view的形式交给FrameCallback，
+ *     view直接指向连接的输入缓冲区，只在回调期间有效，需要保存时由上层自行拷贝
+ * 发：上层把帧内容写进Buffer后调用send，长度头写进Buffer的prepend区，头和内容一次发出，不需要再拷贝或多一次系统调用
+ *
+ * 用法：
+ *   LengthHeaderCodec codec(std::bind(&Server::onFrame, this, _1, _2, _3));
+ *   server.setMessageCallback(std::bind(&LengthHeaderCodec::onMessage, &codec, _1, _2, _3));
+ **/
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using FrameCallback = std::function<void(const TcpConnectionPtr &, std::string_view, Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameSize = 64 * 1024 * 1024;
+
+    explicit LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameSize = kDefaultMaxFrameSize);
+
+    // 解出buf中所有完整的帧 不完整的尾部留在buf中等下一次数据到达
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 在buf的prepend区写入长度头后发送 发送后buf被清空
+    void send(const TcpConnectionPtr &conn, Buffer *buf);
+    // 便捷版本 内容先拷贝进一个临时Buffer
+    void send(const TcpConnectionPtr &conn, std::string_view message);
+
+private:
+    FrameCallback frameCallback_;
+    const size_t maxFrameSize_;
+};
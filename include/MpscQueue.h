@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+/**
+ * 多生产者单消费者的无锁队列(Vyukov侵入式链表)
+ * push可以在任意线程并发调用，只做一次原子exchange；pop和empty只能在唯一的消费者线程中调用。
+ * 生产者exchange之后、链上next之前的极短窗口内，消费者会看到empty()为false而pop()失败，稍后重试即可。
+ *
+ * 节点循环使用，稳定状态下push不分配内存：消费者把用完的节点压入freeNodes_，生产者一次性取走整条空闲链
+ * 放进自己线程的缓存。空闲链只有整条exchange取走而没有单个弹出，不存在ABA问题。
+ * 线程缓存按T共享，从一个队列取到的节点可以用在同类型的另一个队列上。
+ **/
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(new Node())
+        , size_(0)
+        , freeNodes_(nullptr)
+    {
+        tail_ = head_.load(std::memory_order_relaxed);
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(value))
+        {
+        }
+        delete tail_;
+        deleteList(freeNodes_.load(std::memory_order_acquire));
+    }
+
+    void push(T value)
+    {
+        Node *node = allocNode();
+        node->value = std::move(value);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        size_.fetch_add(1, std::memory_order_relaxed);
+        // 使用seq_cst 与消费者"先声明要睡眠再检查队列"配对 见EventLoop::queueInLoop
+        Node *prev = head_.exchange(node, std::memory_order_seq_cst);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T &value)
+    {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+        value = std::move(next->value);
+        tail_ = next; // next成为新的哨兵节点
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        freeNode(tail);
+        return true;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_seq_cst) == tail_; }
+    // 近似值 只用于统计和软上限
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+
+        T value;
+        std::atomic<Node *> next; // 在队列中时指向后继 在空闲链和线程缓存中时指向下一个空闲节点
+    };
+
+    // 每个生产者线程的空闲节点缓存 线程退出时释放
+    struct NodeCache
+    {
+        ~NodeCache() { deleteList(head); }
+        Node *head = nullptr;
+    };
+
+    static void deleteList(Node *node)
+    {
+        while (node)
+        {
+            Node *next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    Node *allocNode()
+    {
+        static thread_local NodeCache cache;
+        if (cache.head == nullptr)
+        {
+            cache.head = freeNodes_.exchange(nullptr, std::memory_order_acquire);
+            if (cache.head == nullptr)
+            {
+                return new Node();
+            }
+        }
+        Node *node = cache.head;
+        cache.head = node->next.load(std::memory_order_relaxed);
+        return node;
+    }
+
+    // 只在消费者线程调用
+    void freeNode(Node *node)
+    {
+        Node *head = freeNodes_.load(std::memory_order_relaxed);
+        do
+        {
+            node->next.store(head, std::memory_order_relaxed);
+        } while (!freeNodes_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    alignas(64) std::atomic<Node *> head_; // 生产者写入端
+    alignas(64) Node *tail_;               // 消费者读取端 指向哨兵节点
+    alignas(64) std::atomic<size_t> size_;
+    std::atomic<Node *> freeNodes_;        // 消费者归还的空闲节点
+
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+#include "ChainBuffer.h"
+
+class BlockPool;
+class BufferPool;
+
+/**
+ * TcpConnection的输出队列，按发送顺序保存还没写进内核的数据，由若干段组成：
+ *   - 拷贝段：send(const std::string&)等接口剩下的数据，拷贝进字节缓冲区(Buffer或ChainBuffer)，段里只记长度
+ *   - 引用段：send(PayloadPtr)剩下的数据，只持有Payload的引用和已发送的偏移，不拷贝
+ *   - 文件段：sendFile剩下的文件区间，只记fd、偏移和长度，不持有fd，调用者要保证发送完成前fd有效
+ * writeFd把队首连续的内存段用一次writev聚合写出，队首是文件段时用sendfile发送，
+ * retrieve按写出的字节数依次消费各段。
+ **/
+class OutputQueue : noncopyable
+{
+public:
+    static const int kMaxIovecs = 64; // 一次writev最多聚合的iovec个数
+
+    OutputQueue();
+    ~OutputQueue();
+
+    size_t readableBytes() const { return bytes_; }
+
+    // 改用ChainBuffer存放拷贝段的数据
+    void useChainBuffer(BlockPool *pool);
+    // 拷贝段的存储只在有数据时从pool借用
+    void setBufferPool(BufferPool *pool);
+    // 按给定的初始大小和扩容倍数重建拷贝段使用的Buffer 只能在还没有数据时调用
+    void initBuffer(size_t initialSize, double growthFactor);
+    size_t bufferCapacity() const { return buffer_.internalCapacity(); }
+    // 把拷贝段使用的Buffer收缩到现有数据再加reserve字节
+    void shrinkBuffer(size_t reserve);
+
+    // 把[data, data+len]拷贝进队尾
+    void append(const char *data, size_t len);
+    // 把payload从offset开始的数据以引用的方式挂到队尾
+    void append(const PayloadPtr &payload, size_t offset);
+    // 把文件fd中[offset, offset+count)的区间挂到队尾 owner非空时持有到这一段发送完为止
+    void appendFile(int fd, off_t offset, size_t count, std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+
+    // 队首是引用段时返回它的Payload以及剩余数据的偏移和长度 否则返回空
+    PayloadPtr frontPayload(size_t *offset, size_t *length) const;
+
+    // 通过fd发送队首的数据 不会消费数据 调用者根据返回值retrieve
+    ssize_t writeFd(int fd, int *saveErrno);
+    void retrieve(size_t len);
+    // 用最多maxIov个iovec描述队首的内存段 遇到文件段为止 返回实际使用的个数 队首是文件段时返回0
+    int fillIovecs(struct iovec *iov, int maxIov) const;
+
+    // 丢弃所有未发送的数据并归还存储 必须在所属loop线程中调用
+    void releaseAll();
+
+private:
+    struct Segment
+    {
+        PayloadPtr payload; // 引用段的数据 拷贝段和文件段为空
+        size_t offset;      // 引用段/文件段中下一个待发送字节的偏移
+        size_t length;      // 本段剩余待发送的字节数
+        int fileFd;         // 文件段的fd 其它段为-1
+        std::shared_ptr<const void> fileOwner; // 文件段fd的所有者 如CachedFile
+    };
+
+    std::deque<Segment> segments_;
+    size_t bytes_;                       // 所有段剩余字节数之和
+
+    Buffer buffer_;                      // 拷贝段的字节缓冲区
+    std::unique_ptr<ChainBuffer> chain_; // 非空时代替buffer_
+    BufferPool *bufferPool_;             // 非空时buffer_的存储从这里借用
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <stddef.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+/**
+ * 不可变、引用计数的发送数据
+ * 同一份数据广播给大量连接时，每个连接的输出队列只持有PayloadPtr加上已发送的偏移，
+ * 不会把数据拷贝进各自的输出缓冲区，内存占用只与数据本身大小有关，与订阅者数量无关。
+ *
+ * 用法：
+ *   PayloadPtr frame = Payload::create(std::move(data));
+ *   for (auto &conn : subscribers) conn->send(frame);
+ *
+ * 也可以引用不属于自己的内存(如mmap的文件)，由owner保证这块内存在Payload存活期间有效。
+ **/
+class Payload : noncopyable
+{
+public:
+    explicit Payload(std::string data)
+        : str_(std::move(data))
+        , data_(str_.data())
+        , size_(str_.size())
+    {
+    }
+
+    Payload(const char *data, size_t size, std::shared_ptr<const void> owner)
+        : data_(data)
+        , size_(size)
+        , owner_(std::move(owner))
+    {
+    }
+
+    static PayloadPtr create(std::string data) { return std::make_shared<const Payload>(std::move(data)); }
+    static PayloadPtr wrap(const char *data, size_t size, std::shared_ptr<const void> owner)
+    {
+        return std::make_shared<const Payload>(data, size, std::move(owner));
+    }
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const std::string str_;
+    const char *const data_;
+    const size_t size_;
+    const std::shared_ptr<const void> owner_; // 引用外部内存时持有内存的所有者
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+/**
+ * 每个EventLoop持有一个的管道池，只在所属loop线程中使用，供TcpConnection::relay用splice在两个socket之间转发数据
+ * 管道都是非阻塞的，创建时按pipeSize设置容量(F_SETPIPE_SZ)；归还时管道里还有残留数据就直接关闭，不放回池中。
+ **/
+class PipePool : noncopyable
+{
+public:
+    static const size_t kDefaultPipeSize = 64 * 1024;
+    static const size_t kDefaultMaxFreePipes = 64;
+
+    struct Pipe
+    {
+        int readFd = -1;
+        int writeFd = -1;
+        size_t capacity = 0; // 内核实际给出的管道容量
+        bool valid() const { return readFd >= 0; }
+    };
+
+    explicit PipePool(size_t pipeSize = kDefaultPipeSize, size_t maxFreePipes = kDefaultMaxFreePipes);
+    ~PipePool();
+
+    // 失败(如fd耗尽)时返回的Pipe不是valid()
+    Pipe acquire();
+    // empty表示管道中已没有数据 可以复用
+    void release(const Pipe &pipe, bool empty);
+
+    size_t freePipes() const { return freeList_.size(); }
+
+private:
+    static void closePipe(const Pipe &pipe);
+
+    const size_t pipeSize_;
+    const size_t maxFreePipes_;
+    std::vector<Pipe> freeList_;
+};
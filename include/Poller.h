@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
@@ -24,15 +24,22 @@ public:
     virtual Timestamp poll(int timeoutMs, ChannelList *activeChannels) = 0;
     virtual void updateChannel(Channel *channel) = 0;
     virtual void removeChannel(Channel *channel) = 0;
+    // 开启或关闭(usecs为0)内核忙轮询 不支持时返回false
+    virtual bool setBusyPoll(uint32_t /*usecs*/, uint16_t /*budget*/, bool /*prefer*/) { return false; }
 
     bool hasChannel(Channel *channel) const;
+    size_t numChannels() const { return numChannels_; }
 
     // 工厂方法，创建默认的 IO 复用器实现（如 EpollPoller）
     static Poller *newDefaultPoller(EventLoop *loop);
 
 protected:
-    using ChannelMap = std::unordered_map<int, Channel*>;
-    ChannelMap channels_;
+    // fd是内核分配的最小可用整数 用fd直接作下标的数组比哈希表查找更快 也更紧凑
+    void addChannelEntry(Channel *channel);
+    void removeChannelEntry(Channel *channel);
+
+    ChannelList channels_; // 下标为fd 未注册的位置为nullptr
+    size_t numChannels_;   // 已注册的Channel数
 
 private:
     EventLoop *ownerLoop_; 
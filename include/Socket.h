@@ -25,6 +25,9 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    void setTcpCork(bool on);
+    // 内核不支持SO_ZEROCOPY时返回false
+    bool setZeroCopy(bool on);
 
 private:
     const int sockfd_;
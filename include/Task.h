@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 只能移动的void()可调用对象，代替std::function作为EventLoop的回调和定时器回调
+ * std::function的内联缓冲区只有16字节，std::bind(&TcpConnection::xxx, shared_from_this(), payload)这样的回调
+ * 一定会在堆上分配，而且std::function要求可拷贝，回调在传递过程中经常被拷贝
+ * Task内联保存不超过kInlineSize字节的可调用对象，只有更大的或移动构造可能抛异常的对象才放到堆上
+ **/
+class Task
+{
+public:
+    // 能放下成员函数指针 + shared_ptr<TcpConnection> + 若干shared_ptr/std::string参数的bind对象
+    static const size_t kInlineSize = 80;
+
+    Task() noexcept : ops_(nullptr) {}
+    Task(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task> &&
+                                          std::is_invocable_v<std::decay_t<F> &>>>
+    Task(F &&f)
+    {
+        using Fn = std::decay_t<F>;
+        if constexpr (kFitsInline<Fn>)
+        {
+            ::new (storage_) Fn(std::forward<F>(f));
+            ops_ = &InlineOps<Fn>::kOps;
+        }
+        else
+        {
+            *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &HeapOps<Fn>::kOps;
+        }
+    }
+
+    Task(Task &&other) noexcept : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            ops_ = other.ops_;
+            if (ops_)
+            {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    // 可以多次调用 定时器的周期回调依赖这一点
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+    // 可调用对象是否放在内联缓冲区里 不涉及堆分配
+    bool isInline() const noexcept { return ops_ == nullptr || ops_->isInline; }
+
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops
+    {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src) noexcept; // 移动到dst并析构src
+        void (*destroy)(void *) noexcept;
+        bool isInline;
+    };
+
+    // 移动构造可能抛异常的对象放在堆上 保证Task的移动是noexcept的
+    template <typename Fn>
+    static constexpr bool kFitsInline = sizeof(Fn) <= kInlineSize &&
+                                        alignof(Fn) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<Fn>;
+
+    template <typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void *p) { (*static_cast<Fn *>(p))(); }
+        static void move(void *dst, void *src) noexcept
+        {
+            Fn *from = static_cast<Fn *>(src);
+            ::new (dst) Fn(std::move(*from));
+            from->~Fn();
+        }
+        static void destroy(void *p) noexcept { static_cast<Fn *>(p)->~Fn(); }
+        static constexpr Ops kOps = {invoke, move, destroy, true};
+    };
+
+    template <typename Fn>
+    struct HeapOps
+    {
+        static void invoke(void *p) { (**static_cast<Fn **>(p))(); }
+        static void move(void *dst, void *src) noexcept { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); }
+        static void destroy(void *p) noexcept { delete *static_cast<Fn **>(p); }
+        static constexpr Ops kOps = {invoke, move, destroy, false};
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops *ops_;
+};
@@ -3,16 +3,29 @@
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "ChainBuffer.h"
+#include "OutputQueue.h"
 #include "Timestamp.h"
+#include "PipePool.h"
+#include "ZeroCopyReaper.h"
 
 class Channel;
 class EventLoop;
 class Socket;
+class BufferPool;
+class IoUringEngine;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
@@ -36,12 +49,96 @@ public:
 
     bool connected() const { return state_ == kConnected; }
 
-    // 发送数据
+    // 发送数据 在其它线程调用时会拷贝一份
     void send(const std::string &buf);
+    /**
+     * 以下三个重载接管数据的所有权：在其它线程调用时数据被移交给loop线程而不拷贝，
+     * socket空闲时直接从这块内存写出，写不完的部分在输出队列中引用它，发送完成后释放
+     **/
+    void send(std::string &&buf);
+    void send(Buffer &&buf);
+    void send(std::unique_ptr<char[]> data, size_t len);
+    // 发送共享的只读数据 未写进内核的部分只在输出队列中保存引用 适合把同一份数据广播给大量连接
+    void send(const PayloadPtr &payload);
+    // 发送buf中全部可读数据并清空buf 在loop线程中调用时不额外拷贝
+    void send(Buffer *buf);
+    /**
+     * 按顺序发送多段数据 如send({header, body, trailer})
+     * 在loop线程中调用时直接从调用者的内存一次writev发出 只把没写完的部分拷贝进输出队列
+     * 在其它线程调用时各段先拼接成一份拷贝再交给loop线程
+     **/
+    void send(std::span<const std::string_view> slices);
+    void send(std::span<const struct iovec> slices);
+    void send(std::initializer_list<std::string_view> slices) { send(std::span<const std::string_view>(slices.begin(), slices.size())); }
+    // 发送文件的[offset, offset+count)区间 与其它send按调用顺序发出 fd由调用者持有 写完成回调之前不能关闭
     void sendFile(int fileDescriptor, off_t offset, size_t count); 
+    // 发送FileCache中的文件 header非空时先发header mmap过的小文件和header用一次writev发出
+    void sendFile(const CachedFilePtr &file, const std::string &header = std::string());
+
+    static const size_t kDefaultZeroCopyThreshold = 32 * 1024;
+    struct ZeroCopyStats
+    {
+        uint64_t sends = 0;       // 带MSG_ZEROCOPY成功发出的次数
+        uint64_t bytes = 0;       // 以MSG_ZEROCOPY发出的字节数
+        uint64_t completions = 0; // 内核已报告完成的次数
+        uint64_t copied = 0;      // 其中内核实际仍做了拷贝的次数 (completions - copied) / completions即命中率
+        uint64_t fallbacks = 0;   // 因ENOBUFS退回普通发送的次数
+    };
+    /**
+     * 剩余不小于threshold字节的Payload改用MSG_ZEROCOPY发送 内核直接引用Payload的内存 发送完成前一直持有Payload
+     * 完成通知从socket错误队列中收取 一旦内核报告发生了拷贝(如回环、网卡不支持)本连接就退回普通发送
+     * 内核不支持SO_ZEROCOPY时返回false 须在connectEstablished之前设置
+     **/
+    bool setZeroCopy(size_t threshold = kDefaultZeroCopyThreshold);
+    const ZeroCopyStats &zeroCopyStats() const { return zeroCopyStats_; }
+
+    /**
+     * 把两个连接对接起来：两个方向的数据都经由loop管道池中的管道用splice在内核中转发，不再进入inputBuffer_和用户回调
+     *   - 背压：管道满了就暂停读取来源连接，目标连接写不动时管道不会被取空
+     *   - 半关闭：一端发来FIN后，管道中剩余数据转发完就关闭另一端的写端，两个方向都结束后关闭两个连接
+     *   - 一端出错或被关闭时另一端随之强制关闭
+     * 对接前已经读进inputBuffer_的数据先按普通方式发给对方。两个连接必须属于同一个loop，且在该loop线程中调用
+     **/
+    static bool relay(const TcpConnectionPtr &a, const TcpConnectionPtr &b);
+    bool relaying() const { return relayPipe_.valid(); }
     
+    /**
+     * 自动合并写：本轮loop中的send都只追加到输出队列，连接登记为待写，
+     * 在doPendingFunctors之后对每个待写连接统一writev一次。一次回调里多次send时系统调用从N次降为1次
+     * tcpCork为true时写出期间打开TCP_CORK 输出队列含文件段需要分几次写时也能凑满报文再发
+     * 须在loop线程中或connectEstablished之前设置
+     **/
+    void setAutoCork(bool on, bool tcpCork = false) { autoCork_ = on; tcpCork_ = on && tcpCork; }
+
+    static const size_t kDefaultEdgeBudget = 256 * 1024;
+    /**
+     * 边沿触发：fd以EPOLLET注册，一次事件里反复读/写到EAGAIN为止，没读完的socket不会在每次epoll_wait时被重复上报
+     * 每次事件最多读/写budget字节，用完预算时socket上可能还有数据，此时把本连接排到本轮其它事件之后(queueInLoop)继续，
+     * 不会饿死同一loop上的其它连接；一次事件里读到的数据只回调一次消息回调。对接(relay)时自动退回水平触发
+     * 须在loop线程中或connectEstablished之前设置
+     **/
+    void setEdgeTriggered(bool on, size_t budget = kDefaultEdgeBudget);
+    bool edgeTriggered() const { return edgeTriggered_; }
+
+    /**
+     * 完成式I/O：连接建立后改由本loop的IoUringEngine收发，不再等待可读/可写事件：
+     * 挂一个multishot recv，内核把数据直接放进共享的接收缓冲区，每段数据一个完成项；
+     * 输出队列用一次sendmsg聚合发出，上一次完成后再发下一次，本轮追加的数据合并到同一次提交中
+     * 输出队列改用ChainBuffer(数据在发送完成前不能移动)，不支持对接(relay)、MSG_ZEROCOPY和边沿触发
+     * 内核不支持时仍使用Poller 须在connectEstablished之前设置
+     **/
+    void setIoUring(bool on) { useIoUring_ = on; }
+    bool completionMode() const { return uring_ != nullptr; }
+
     // 关闭半连接
     void shutdown();
+    // 强制关闭连接 不等待输出队列中的数据发完
+    void forceClose();
+
+    // 暂停/恢复读取对端数据 用于应用层背压
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
 
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
@@ -50,6 +147,20 @@ public:
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
 
+    // 改用ChainBuffer作为输入缓冲区，收到的数据通过cb上报，须在有数据到达之前设置(比如在TcpServer::newConnection中)
+    void setChainMessageCallback(const ChainMessageCallback &cb);
+    // 改用ChainBuffer作为输出缓冲区，大块数据追加时不再搬移和扩容拷贝，须在发送数据之前设置
+    void setOutputChainBuffer();
+    // 输入缓冲区和输出队列平时不持有存储，有数据收发时才从pool借用，须在connectEstablished之前设置
+    void setBufferPool(BufferPool *pool);
+    // 启用自适应接收 按本连接的典型读取量准备readv空间 useFionread为true时大块读取用FIONREAD精确确定大小
+    void setAdaptiveRead(bool useFionread) { adaptiveRead_ = true; readSizer_ = ReadSizer(useFionread); }
+    // 按策略重建输入缓冲区和输出队列 须在setBufferPool和connectEstablished之前设置
+    void setBufferPolicy(const BufferPolicy &policy);
+    // 输入缓冲区或待发送数据超过策略上限时回调 输入超限时会先暂停读取 降回上限以下后自动恢复
+    // 不设置该回调时超限的连接会被强制关闭
+    void setBufferOverflowCallback(const BufferOverflowCallback &cb) { bufferOverflowCallback_ = cb; }
+
     void connectEstablished();
     void connectDestroyed();
 
@@ -72,7 +183,64 @@ private:
     // 内部发送和关闭操作（在事件循环线程中执行）
     void sendInLoop(const void *data, size_t len);
     void shutdownInLoop();
-    void sendFileInLoop(int fileDescriptor, off_t offset, size_t count);
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    void sendFileInLoop(int fileDescriptor, off_t offset, size_t count, const std::shared_ptr<const void> &owner);
+    void sendCachedFileInLoop(const CachedFilePtr &file, const std::string &header);
+    // 把head和payload作为连续的数据发送 直接写时合并成一次writev
+    void sendHeadAndPayloadInLoop(const std::string &head, const PayloadPtr &payload);
+
+    void sendPayloadInLoop(const PayloadPtr &payload);
+    void sendSlicesInLoop(const struct iovec *slices, size_t count);
+
+    // 输出队列为空且没有在等待EPOLLOUT时 数据可以不经过输出队列直接写进socket
+    bool canWriteDirectly() const;
+    // 把iov描述的共len字节直接写进socket 返回写出的字节数 对端已经断开时置faultError
+    size_t writeDirectly(const struct iovec *iov, int iovcnt, size_t len, bool *faultError);
+    // 处理直接写的结果 返回写出的字节数
+    size_t checkDirectWrite(ssize_t nwrote, size_t len, bool *faultError);
+    // 以MSG_ZEROCOPY发送payload从offset开始的len字节 返回值同::send
+    ssize_t sendZeroCopy(const PayloadPtr &payload, size_t offset, size_t len);
+    // 收取错误队列中的零拷贝完成通知 释放对应的Payload 收到过通知时返回true
+    bool reapZeroCopyCompletions();
+    // splice转发相关
+    void startRelay(const TcpConnectionPtr &peer, const PipePool::Pipe &pipe);
+    void handleRelayRead();
+    void relayFlush(); // 把对方管道中的数据splice进本连接的socket
+    void stopRelay();
+    // 发送队首的数据 返回值同::write
+    ssize_t writeQueued(int *savedErrno);
+    // 输出队列发完后的收尾 关闭写事件 回调写完成 处理延迟的shutdown和splice转发
+    void handleQueueDrained();
+    // 数据进入输出队列后安排写出 普通模式下注册EPOLLOUT 自动合并写时登记本轮末尾的写
+    void scheduleWrite();
+    void flushCorked();
+    // 有adding字节即将进入输出队列 检查是否越过高水位
+    void checkHighWaterMark(size_t adding);
+
+    // 缓冲区策略相关
+    size_t inputBytes() const;
+    ssize_t readOnce(int *savedErrno); // 按当前的输入缓冲区配置读一次
+    void scheduleEdgeRead();           // 边沿触发下预算用完 排队继续读
+    void scheduleEdgeWrite();
+    void continueEdgeRead();
+    void continueEdgeWrite();
+    void checkInputLimit();
+    void checkOutputLimit();
+    void noteBufferActivity();  // 有读写发生时调用 必要时登记每轮循环末尾的检查
+    bool needsIterationCheck() const;
+    bool checkBufferIdle();     // 每轮循环末尾执行 恢复被暂停的读取 空闲足够久后收缩缓冲区
+    void deliverInput(Timestamp receiveTime); // 把输入缓冲区中的数据交给消息回调
+
+    // 完成式I/O相关
+    void enterCompletionMode();
+    void onInterestChanged();   // Channel关注事件变化时调用 按需挂上或取消recv/send请求
+    void armRecv();
+    void prepareSend();         // 在本轮提交之前执行 把输出队列队首的数据组成一次sendmsg
+    void handleRecvCompletion(int res, uint32_t flags);
+    void handleSendCompletion(int res, uint32_t flags);
+    void handleSendReady(int res, uint32_t flags); // 队首文件段等到可写
 
     EventLoop *loop_;           // 所属事件循环对象指针
     const std::string name_;    // 连接名称
@@ -94,5 +262,51 @@ private:
     size_t highWaterMark_;                        // 高水位阈值
 
     Buffer inputBuffer_;    // 接收数据缓冲区
-    Buffer outputBuffer_;   // 发送数据缓冲区
+    OutputQueue outputQueue_; // 发送数据队列
+
+    ChainMessageCallback chainMessageCallback_;   // 使用inputChain_时的消息回调
+    std::unique_ptr<ChainBuffer> inputChain_;     // 非空时代替inputBuffer_接收数据
+    BufferPool *bufferPool_;                      // 非空时inputBuffer_的存储从这里借用
+    bool adaptiveRead_;                           // 是否启用自适应接收
+    ReadSizer readSizer_;                         // 自适应接收时记录本连接的典型读取量
+
+    BufferPolicy bufferPolicy_;                     // 缓冲区策略
+    BufferOverflowCallback bufferOverflowCallback_; // 缓冲区超过上限时的回调
+    bool iterationCheckRegistered_;                 // 是否已在loop中登记了每轮末尾的检查
+    uint64_t lastActiveIteration_;                  // 最近一次有读写时loop的轮数
+    bool inputOverflowed_;                          // 输入超限 读取已被暂停
+    bool outputOverflowed_;                         // 待发送数据超限 已经回调过
+
+    size_t zeroCopyThreshold_;                   // 0表示不使用MSG_ZEROCOPY
+    uint32_t zeroCopyNextId_;
+    ZeroCopyReaper::PendingQueue zeroCopyPending_; // 还没收到完成通知的发送
+    ZeroCopyStats zeroCopyStats_;
+
+    std::weak_ptr<TcpConnection> relayPeer_; // 对接的另一个连接
+    PipePool::Pipe relayPipe_;               // 从本连接读出、等待写给relayPeer_的数据所在的管道
+    size_t relayPipeBytes_;                  // relayPipe_中的数据量
+    bool relayReadEof_;                      // 本连接已读到FIN
+    bool relayWriteShut_;                    // 本连接的写端已因对方FIN而关闭
+
+    bool autoCork_;         // 是否自动合并本轮loop中的写
+    bool tcpCork_;          // 合并写时是否使用TCP_CORK
+    bool corkFlushPending_; // 是否已登记本轮末尾的写
+
+    bool edgeTriggered_;    // 是否边沿触发
+    size_t edgeBudget_;     // 边沿触发时每次事件最多读/写的字节数
+    bool edgeReadPending_;  // 已排队继续读
+    bool edgeWritePending_; // 已排队继续写
+
+    struct UringSendState
+    {
+        struct msghdr msg;
+        struct iovec iov[OutputQueue::kMaxIovecs];
+    };
+    bool useIoUring_;                         // 是否请求使用完成式I/O
+    IoUringEngine *uring_;                    // 非空时处于完成式I/O模式
+    uint64_t recvRequest_;                    // 挂着的multishot recv 0表示没有
+    uint64_t sendRequest_;                    // 进行中的sendmsg或等待可写的poll 同一时刻最多一个
+    bool sendPrepPending_;                    // 已登记本轮提交前的prepareSend
+    bool inputUndelivered_;                   // 暂停读取期间收到了数据 恢复读取时补发消息回调
+    std::unique_ptr<UringSendState> uringSend_; // 进行中的sendmsg引用的msghdr和iovec
 };
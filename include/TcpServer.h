@@ -8,6 +8,7 @@
 #include <string>
 #include <memory>
 #include <atomic>
+#include <vector>
 #include <unordered_map>
 
 #include "EventLoop.h"
@@ -31,6 +32,12 @@ public:
         kReusePort,//允许重用本地端口
     };
 
+    enum IoEngine
+    {
+        kReadinessEngine, // 等待Poller报告可读/可写后自己读写(默认)
+        kIoUringEngine,   // 由各loop的IoUringEngine完成收发和accept 见TcpConnection::setIoUring
+    };
+
     TcpServer(EventLoop *loop,
               const InetAddress &listenAddr,
               const std::string &nameArg,
@@ -41,6 +48,32 @@ public:
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 设置后新连接改用ChainBuffer作为输入缓冲区 消息通过该回调上报
+    void setChainMessageCallback(const ChainMessageCallback &cb) { chainMessageCallback_ = cb; }
+    // 新连接改用ChainBuffer作为输出缓冲区
+    void setOutputChainBuffer(bool on) { outputChainBuffer_ = on; }
+    // 新连接的输入缓冲区和输出队列只在有数据收发时才从所属loop的BufferPool借用存储
+    void setBufferPooling(bool on) { bufferPooling_ = on; }
+    // 新连接启用自适应接收 见TcpConnection::setAdaptiveRead
+    void setAdaptiveRead(bool on, bool useFionread = false) { adaptiveRead_ = on; useFionread_ = useFionread; }
+    // 新连接按该策略设置缓冲区 见BufferPolicy
+    void setBufferPolicy(const BufferPolicy &policy) { bufferPolicy_ = policy; hasBufferPolicy_ = true; }
+    // 连接缓冲区超过策略上限时的回调 见TcpConnection::setBufferOverflowCallback
+    void setBufferOverflowCallback(const BufferOverflowCallback &cb) { bufferOverflowCallback_ = cb; }
+    // 新连接发送较大的Payload时使用MSG_ZEROCOPY 见TcpConnection::setZeroCopy
+    void setZeroCopy(bool on, size_t threshold = TcpConnection::kDefaultZeroCopyThreshold) { zeroCopyThreshold_ = on ? threshold : 0; }
+    // 新连接启用自动合并写 见TcpConnection::setAutoCork
+    void setAutoCork(bool on, bool tcpCork = false) { autoCork_ = on; tcpCork_ = tcpCork; }
+    // 新连接使用边沿触发 见TcpConnection::setEdgeTriggered
+    void setEdgeTriggered(bool on, size_t budget = TcpConnection::kDefaultEdgeBudget) { edgeTriggered_ = on; edgeBudget_ = budget; }
+    // 选择I/O引擎 须在start之前设置 内核不支持io_uring时自动退回kReadinessEngine
+    void setIoEngine(IoEngine engine);
+    /**
+     * 每个subloop各自持有一个绑定在同一端口上的SO_REUSEPORT Acceptor，由内核按连接的四元组哈希分给各个监听socket，
+     * 连接在接受它的loop中直接建立，登记和关闭也都在这个loop中完成，不再经过mainloop逐个accept再跨线程投递
+     * 没有subloop(setThreadNum(0))时不起作用 须在start之前设置
+     **/
+    void setPerLoopAcceptors(bool on) { perLoopAcceptors_ = on; }
 
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
@@ -58,8 +91,20 @@ private:
 
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
+    // 一个subloop自己的Acceptor和它接受的连接 只在该loop中访问
+    struct LoopAcceptor
+    {
+        std::unique_ptr<Acceptor> acceptor;
+        ConnectionMap connections;
+    };
+    // 在ioLoop中为sockfd建立连接 在接受连接的线程中调用 owner非空时连接登记在owner中
+    void establishConnection(EventLoop *ioLoop, LoopAcceptor *owner, int sockfd, const InetAddress &peerAddr);
+    // 不引用TcpServer 析构后仍在关闭的连接只访问owner
+    static void removeLoopConnection(LoopAcceptor *owner, const TcpConnectionPtr &conn);
+
     EventLoop *loop_; // baseloop 用户自定义的loop
 
+    const InetAddress listenAddr_;
     const std::string ipPort_;
     const std::string name_;
 
@@ -70,10 +115,26 @@ private:
     ConnectionCallback connectionCallback_;       //有新连接时的回调
     MessageCallback messageCallback_;             // 有读写事件发生时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成后的回调
+    ChainMessageCallback chainMessageCallback_;   // 输入使用ChainBuffer时的消息回调
+    bool outputChainBuffer_;                      // 输出是否使用ChainBuffer
+    bool bufferPooling_;                          // 缓冲区存储是否从loop的BufferPool借用
+    bool adaptiveRead_;                           // 是否启用自适应接收
+    bool useFionread_;                            // 自适应接收时是否使用FIONREAD
+    BufferPolicy bufferPolicy_;                   // 新连接的缓冲区策略
+    bool hasBufferPolicy_;                        // 是否设置过缓冲区策略
+    BufferOverflowCallback bufferOverflowCallback_; // 缓冲区超限时的回调
+    size_t zeroCopyThreshold_;                    // 0表示不使用MSG_ZEROCOPY
+    bool autoCork_;                               // 是否自动合并每轮loop中的写
+    bool tcpCork_;                                // 合并写时是否使用TCP_CORK
+    bool edgeTriggered_;                          // 新连接是否边沿触发
+    size_t edgeBudget_;                           // 边沿触发时每次事件的读写预算
+    IoEngine ioEngine_;                           // 新连接使用的I/O引擎
+    bool perLoopAcceptors_;                       // 是否每个subloop各自接受连接
+    std::vector<std::unique_ptr<LoopAcceptor>> loopAcceptors_; // 各subloop的Acceptor和连接
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
     int numThreads_;//线程池中线程的数量。
     std::atomic_int started_;
-    int nextConnId_;
+    std::atomic_int nextConnId_; // 每个subloop各自接受连接时在多个线程中递增
     ConnectionMap connections_; // 保存所有的连接
 };
\ No newline at end of file
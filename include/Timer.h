@@ -4,37 +4,62 @@
 #include "Callbacks.h"
 #include "noncopyable.h"
 #include <atomic>
+#include <stdint.h>
 
 class Timer : noncopyable
 {
 public:
-  Timer(TimerCallback cb, Timestamp when, double interval)
+  static constexpr size_t kNotInHeap = SIZE_MAX;
+
+  // slack是可以接受的延迟 到期时间会按slack向后对齐 见roundUp
+  Timer(TimerCallback cb, Timestamp when, double interval, double slack = 0.0)
     : callback_(std::move(cb))
-    , expiration_(when)
+    , expiration_(roundUp(when, slack))
     , interval_(interval)
+    , slack_(slack)
     , repeat_(interval > 0.0)
     , sequence_(++s_numCreated_)
+    , heapIndex_(kNotInHeap)
+    , canceled_(false)
     { }
 
-    void run() const
+    // TimerQueue从空闲链表中复用Timer对象时重新初始化 序列号重新分配 旧的TimerId随之失效
+    void reset(TimerCallback cb, Timestamp when, double interval, double slack);
+    // 归还到空闲链表前释放回调持有的资源 序列号清零 任何TimerId都不再匹配
+    void release();
+
+    void run()
     {
         callback_();    // 定时器到期时执行的回调函数
     }
 
     Timestamp expiration() const  { return expiration_; }   // 到期时间
     bool repeat() const { return repeat_; }                 // 是否是周期性定时器
-    int64_t sequence() const { return sequence_; }          // 序列号，用于区分不同定时器
+    int64_t sequence() const { return sequence_; }          // 序列号，用于区分不同定时器 同一个Timer对象每次复用都不同
 
     void restart(Timestamp now);                            // 重启定时器，周期性定时器到期后重置下次到期时间
 
-    static int64_t numCreated() { return s_numCreated_.load(); }    // 获取已创建定时器的总数
+    // 在TimerQueue堆中的下标 不在堆中时为kNotInHeap 由TimerQueue维护
+    size_t heapIndex() const { return heapIndex_; }
+    void setHeapIndex(size_t index) { heapIndex_ = index; }
+    // 正在执行的这一批到期定时器被取消时打上标记 不再执行也不再重启
+    bool canceled() const { return canceled_; }
+    void setCanceled() { canceled_ = true; }
+
+    // 把when向后对齐到slack的整数倍 落在同一个slack区间内的定时器到期时间相同 由TimerQueue一起触发
+    static Timestamp roundUp(Timestamp when, double slack);
+
+    static int64_t numCreated() { return s_numCreated_.load(); }    // 获取已分配的定时器序列号总数
 
 private:
-    const TimerCallback callback_;
+    TimerCallback callback_;
     Timestamp expiration_;
-    const double interval_;
-    const bool repeat_;
-    const int64_t sequence_;
+    double interval_;
+    double slack_;
+    bool repeat_;
+    int64_t sequence_;
+    size_t heapIndex_;
+    bool canceled_;
 
     static std::atomic<int64_t> s_numCreated_;
 };
\ No newline at end of file
@@ -23,7 +23,7 @@ public:
 
 private:
     Timer* timer_;          // 指向实际定时器对象的指针
-    int64_t sequence_;      // 定时器的唯一序号
+    int64_t sequence_;      // 定时器的唯一序号 Timer对象会被复用 序号相当于代数 不匹配说明定时器已经结束
 };
 
 
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <set>
 #include <vector>
 #include "Timestamp.h"
 #include "Callbacks.h"
@@ -10,38 +9,49 @@ class EventLoop;
 class Timer;
 class TimerId;
 
-// TimerQueue负责管理所有定时器，基于定时器文件描述符实现高效定时任务调度
+/**
+ * TimerQueue负责管理所有定时器，基于定时器文件描述符实现高效定时任务调度
+ * 定时器放在按(到期时间, 序列号)排序的4叉最小堆里，Timer自己记录在堆中的下标，取消时不需要查找，O(log n)
+ * 到期或取消的Timer放回本loop的空闲链表复用，在loop线程中反复添加、取消定时器不会分配内存；
+ * 其它线程调用addTimer时不能访问空闲链表，仍然new一个Timer，用完后同样进入空闲链表
+ **/
 class TimerQueue : noncopyable
 {
 public:
   explicit TimerQueue(EventLoop* loop);
   ~TimerQueue();
 
-  TimerId addTimer(TimerCallback cb, Timestamp when, double interval);  // 添加定时器
+  // 添加定时器 可以在任意线程调用 slack见Timer::roundUp
+  TimerId addTimer(TimerCallback cb, Timestamp when, double interval, double slack = 0.0);
   void cancel(TimerId timerId);     // 取消定时器
 
+  size_t size() const { return heap_.size(); }    // 堆中的定时器数 只在loop线程中有意义
+
 private:
-  // 用unique_ptr<Timer>管理定时器对象，提升异常安全
-  using Entry = std::pair<Timestamp, Timer*>;
-  using TimerList = std::set<Entry>;
-  using ActiveTimer = std::pair<Timer*, int64_t>;
-  using ActiveTimerSet = std::set<ActiveTimer>;
+  static const size_t kArity = 4;
 
   void addTimerInLoop(Timer* timer);
   void cancelInLoop(TimerId timerId);
   void handleRead();
-  std::vector<Entry> getExpired(Timestamp now);
-  void reset(const std::vector<Entry>& expired, Timestamp now);
+  void getExpired(Timestamp now);
+  void reset(Timestamp now);
   bool insert(Timer* timer);
 
+  Timer* acquireTimer(TimerCallback cb, Timestamp when, double interval, double slack);
+  void releaseTimer(Timer* timer);
+
+  // 4叉堆操作 移动元素时同步更新Timer::heapIndex
+  static bool earlier(const Timer* lhs, const Timer* rhs);
+  void place(size_t index, Timer* timer);
+  void siftUp(size_t index);
+  void siftDown(size_t index);
+  void removeAt(size_t index);
+
   EventLoop* loop_;
   const int timerfd_;
   Channel timerfdChannel_;
-  TimerList timers_;
-
-  // for cancel()
-  ActiveTimerSet activeTimers_;
+  std::vector<Timer*> heap_;       // heap_[0]最早到期
+  std::vector<Timer*> freeTimers_; // 空闲链表 只在loop线程中访问
+  std::vector<Timer*> expired_;    // 本次handleRead到期的定时器 复用存储
   bool callingExpiredTimers_;
-  ActiveTimerSet cancelingTimers_;
 };
-
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+#include "Task.h"
+
+class EventLoop;
+
+// 标识时间轮中的一个定时器 槽位被复用后generation不同 旧的id自动失效
+class WheelTimerId
+{
+public:
+    WheelTimerId()
+        : index_(0)
+        , generation_(0)
+    {
+    }
+
+    bool valid() const { return generation_ != 0; }
+
+    friend class TimingWheel;
+
+private:
+    WheelTimerId(uint32_t index, uint32_t generation)
+        : index_(index)
+        , generation_(generation)
+    {
+    }
+
+    uint32_t index_;
+    uint32_t generation_;
+};
+
+/**
+ * 分层时间轮(与Linux早期内核定时器相同的256 + 3 * 64结构)，用于只需要tick精度的连接级超时
+ * 添加、取消、重新设置都是O(1)：定时器节点放在按下标访问的deque里，用下标串成双向链表，空闲节点复用，稳定状态下不分配内存
+ * 第0层每个槽对应一个tick，第1层以上的槽在低层转完一圈时整体下放(cascade)到低一层
+ * 时间轮自己不创建timerfd，而是在有定时器时通过EventLoop::runEvery每个tick推进一次，和TimerQueue共用同一个timerfd；
+ * 轮中为空时停掉这个tick，不会空转唤醒loop
+ * 到期时间向后取整到tick，保证不早于要求的时间触发，最多晚一个tick；只能在所属loop线程中使用
+ **/
+class TimingWheel : noncopyable
+{
+public:
+    using Callback = Task;
+
+    static constexpr double kDefaultTick = 0.1; // 秒
+
+    TimingWheel(EventLoop *loop, double tickSeconds = kDefaultTick);
+    ~TimingWheel();
+
+    // delay秒后执行cb 一次性
+    WheelTimerId schedule(double delay, Callback cb);
+    // 重新设置为从现在起delay秒后到期 用于每收到一条消息就推迟的空闲超时；定时器已经触发或被取消时返回false
+    bool restart(WheelTimerId id, double delay);
+    // 定时器已经触发或被取消时返回false
+    bool cancel(WheelTimerId id);
+
+    size_t size() const { return count_; }
+    double tick() const { return tickUs_ / static_cast<double>(Timestamp::kMicroSecondsPerSecond); }
+
+private:
+    static constexpr int kRootBits = 8;
+    static constexpr int kLevelBits = 6;
+    static constexpr int kLevels = 4; // 第0层 + 3层 共覆盖2^26个tick
+    static constexpr uint32_t kRootSize = 1u << kRootBits;
+    static constexpr uint32_t kLevelSize = 1u << kLevelBits;
+    static constexpr uint32_t kRootMask = kRootSize - 1;
+    static constexpr uint32_t kLevelMask = kLevelSize - 1;
+    static constexpr uint64_t kMaxTicks = (1ull << (kRootBits + (kLevels - 1) * kLevelBits)) - 1;
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Node
+    {
+        Callback cb;
+        uint64_t expires = 0;        // 到期的tick
+        uint32_t prev = kNil;
+        uint32_t next = kNil;
+        uint32_t generation = 1;     // 每次释放加一 0保留给无效id
+        uint32_t *slot = nullptr;    // 所在槽的链表头 nullptr表示不在轮中
+    };
+
+    uint64_t ticksFor(double delay) const;
+    Node *lookup(WheelTimerId id);
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(int level, uint32_t slot);
+    void startTicking();
+    void onTick();
+    void runTick();
+
+    EventLoop *loop_;
+    const int64_t tickUs_;
+    const Timestamp start_;        // tick的计时起点
+    uint64_t nextTick_;            // 下一个要处理的tick
+    size_t count_;                 // 轮中的定时器数
+
+    std::deque<Node> nodes_;       // deque扩容时不移动已有节点
+    std::vector<uint32_t> freeList_;
+    std::vector<uint32_t> root_;   // 第0层的槽 存链表头下标
+    std::vector<uint32_t> levels_[kLevels - 1];
+    uint32_t expiring_;            // 正在执行的这一批到期定时器
+
+    bool ticking_;
+    TimerId tickTimer_;
+};
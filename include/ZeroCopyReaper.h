@@ -0,0 +1,61 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+class EventLoop;
+class Channel;
+
+/**
+ * 每个EventLoop持有一个的零拷贝收尾器，只在所属loop线程中使用。
+ * MSG_ZEROCOPY发送的完成通知到达之前，skb直接引用着Payload的内存。连接销毁时如果就此释放Payload，
+ * 页虽然被锁定着不会还给内核，却可能被malloc复用改写，重传或还在排队的数据就被破坏了。
+ * 所以连接销毁时把还没完成的发送交给这里：dup一份socket fd并关闭写端，在错误队列上等完成通知到齐，
+ * 再释放Payload并关闭fd。对端一直不确认时，TCP重传超时后skb被释放，完成通知同样会到达。
+ **/
+class ZeroCopyReaper : noncopyable
+{
+public:
+    struct Pending
+    {
+        uint32_t id;        // 内核为每次成功的MSG_ZEROCOPY发送分配的递增序号
+        PayloadPtr payload; // 完成通知到达前内核还在引用这块内存
+    };
+    using PendingQueue = std::deque<Pending>;
+    // 一条通知确认序号区间[lo, hi]内的发送全部完成 copied表示内核实际做了拷贝
+    using RangeCallback = std::function<void(uint32_t lo, uint32_t hi, bool copied)>;
+
+    explicit ZeroCopyReaper(EventLoop *loop);
+    ~ZeroCopyReaper();
+
+    // 取出fd错误队列中的所有零拷贝完成通知，从pending中释放已完成的发送 返回是否取到了通知
+    static bool reap(int fd, PendingQueue *pending, const RangeCallback &onRange = RangeCallback());
+
+    // 接管fd上还没完成的发送 fd仍归调用方所有，之后照常关闭
+    void adopt(int fd, PendingQueue pending);
+
+    size_t draining() const { return drains_.size(); } // 还在等完成通知的socket数
+
+private:
+    struct Drain
+    {
+        int fd; // dup出来的fd 原fd关闭后socket仍然存在
+        std::unique_ptr<Channel> channel;
+        PendingQueue pending;
+        bool finishing = false; // 已经登记了finish
+    };
+
+    void handleEvent(int fd);
+    void finish(int fd);
+
+    EventLoop *loop_;
+    std::unordered_map<int, std::unique_ptr<Drain>> drains_; // 以dup出来的fd为键
+    std::vector<PendingQueue> orphans_; // dup失败时无法再等通知 Payload留到loop析构时释放
+};
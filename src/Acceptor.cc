@@ -2,10 +2,14 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <string.h>
+#include <netinet/in.h>
 
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "EventLoop.h"
+#include "IoUringEngine.h"
 
 // 创建一个非阻塞、自动关闭的 TCP socket
 static int createNonblocking()
@@ -24,6 +28,9 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
     , acceptSocket_(createNonblocking())
     , acceptChannel_(loop, acceptSocket_.fd())
     , listenning_(false)
+    , useIoUring_(false)
+    , uring_(nullptr)
+    , acceptRequest_(0)
 {
     acceptSocket_.setReuseAddr(true);      // 启用地址复用
     acceptSocket_.setReusePort(true);      // 启用端口复用
@@ -36,6 +43,14 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
 // 移除事件监听并释放资源
 Acceptor::~Acceptor()
 {
+    if (uring_)
+    {
+        // 挂着的accept持有监听socket的引用 取消完成或ring销毁之前close不会真正关闭它，
+        // 同一端口上新启动的reuseport监听者会被分到连接，接受后又随ring一起关掉；shutdown立即停止监听
+        ::shutdown(acceptSocket_.fd(), SHUT_RDWR);
+        uring_->cancel(acceptRequest_, true); // 回调引用了this 之后的完成项直接丢弃
+        return;
+    }
     acceptChannel_.disableAll(); // 移除所有事件监听
     acceptChannel_.remove();     // 从事件循环中移除通道
 }
@@ -45,9 +60,56 @@ void Acceptor::listen()
 {
     listenning_ = true;
     acceptSocket_.listen();         // 启动 socket 监听
+    if (useIoUring_ && (uring_ = loop_->ioUring()) != nullptr)
+    {
+        armAccept();
+        return;
+    }
     acceptChannel_.enableReading(); // 注册读事件到 Poller
 }
 
+void Acceptor::armAccept()
+{
+    acceptRequest_ = uring_->acceptMultishot(acceptSocket_.fd(),
+        std::bind(&Acceptor::handleAcceptCompletion, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+// multishot accept每接受一个连接产生一个完成项 res是新连接的fd
+void Acceptor::handleAcceptCompletion(int res, uint32_t flags)
+{
+    bool more = flags & IORING_CQE_F_MORE;
+    if (!more)
+    {
+        acceptRequest_ = 0;
+    }
+    if (res >= 0)
+    {
+        // 完成项不带对端地址 与accept4相同从socket取
+        sockaddr_in addr;
+        socklen_t len = sizeof addr;
+        ::memset(&addr, 0, sizeof addr);
+        ::getpeername(res, reinterpret_cast<sockaddr *>(&addr), &len);
+        InetAddress peerAddr;
+        peerAddr.setSockAddr(addr);
+        if (NewConnectionCallback_)
+        {
+            NewConnectionCallback_(res, peerAddr);
+        }
+        else
+        {
+            ::close(res);
+        }
+    }
+    else if (res != -ECANCELED)
+    {
+        LOG_ERROR("Acceptor::handleAcceptCompletion accept error:%d\n", -res);
+    }
+    if (!more && res != -ECANCELED)
+    {
+        armAccept(); // 出错时multishot请求会结束 重新挂上
+    }
+}
+
 // 处理监听 socket 上的读事件（即有新连接到来）
 void Acceptor::handleRead()
 {
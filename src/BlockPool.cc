@@ -0,0 +1,41 @@
+#include "BlockPool.h"
+
+BlockPool::BlockPool(size_t blockSize, size_t maxFreeBlocks)
+    : blockSize_(blockSize)
+    , maxFreeBlocks_(maxFreeBlocks)
+    , usedBlocks_(0)
+{
+}
+
+BlockPool::~BlockPool()
+{
+    for (char *block : freeList_)
+    {
+        delete[] block;
+    }
+}
+
+char *BlockPool::allocate()
+{
+    ++usedBlocks_;
+    if (freeList_.empty())
+    {
+        return new char[blockSize_]; // 不做清零 块里的内容总是先写后读
+    }
+    char *block = freeList_.back();
+    freeList_.pop_back();
+    return block;
+}
+
+void BlockPool::deallocate(char *block)
+{
+    --usedBlocks_;
+    if (freeList_.size() < maxFreeBlocks_)
+    {
+        freeList_.push_back(block);
+    }
+    else
+    {
+        delete[] block; // 空闲块已经足够多了 多余的还给系统
+    }
+}
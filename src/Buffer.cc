@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 
 #include "Buffer.h"
 
@@ -15,7 +16,7 @@
 ssize_t Buffer::readFd(int fd, int *saveErrno)
 {
     // 栈额外空间，用于从套接字往出读时，当buffer_暂时不够用时暂存数据，待buffer_重新分配足够空间后，在把数据交换给buffer_。
-    char extrabuf[65536] = {0}; // 栈上内存空间 65536/1024 = 64KB
+    char extrabuf[65536]; // 栈上内存空间 65536/1024 = 64KB 只作为readv的目标 不需要清零
 
     /*
     struct iovec {
@@ -52,12 +53,66 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     }
     else // extrabuf里面也写入了n-writable长度的数据
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable; // 存储被BufferPool收走时writable为0 不能直接取buffer_.size()
         append(extrabuf, n - writable); // 对buffer_扩容 并将extrabuf存储的另一部分数据追加至buffer_
     }
     return n;
 }
 
+/**
+ * 自适应接收：
+ * 1. 按sizer预估的本连接典型读取量预留可写空间，小消息的连接不会每次都用到64KB的额外空间
+ * 2. 额外空间使用调用方提供的spill区(每个EventLoop一块，反复复用)，而不是每次在栈上开一个新数组
+ * 3. 预估值很大时可选用FIONREAD查询内核中待读的字节数，一次把空间准备到位，避免溢出后的二次拷贝
+ **/
+ssize_t Buffer::readFd(int fd, int *saveErrno, ReadSizer *sizer, char *spill, size_t spillSize, bool keepStorage)
+{
+    size_t target = sizer->expected();
+    if (keepStorage)
+    {
+        // 池化的存储按预估值扩容后，归还时会被BufferPool当作超大存储释放，每次读都要一次分配和释放
+        target = std::min(target, writableBytes());
+    }
+    else
+    {
+        if (sizer->useFionread())
+        {
+            int avail = 0;
+            if (::ioctl(fd, FIONREAD, &avail) == 0 && avail > 0)
+            {
+                target = static_cast<size_t>(avail);
+            }
+        }
+        ensureWritableBytes(target);
+    }
+
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = begin() + writerIndex_;
+    vec[0].iov_len = writable;
+    vec[1].iov_base = spill;
+    vec[1].iov_len = spillSize;
+
+    const ssize_t n = ::readv(fd, vec, 2);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+        return n;
+    }
+
+    if (static_cast<size_t>(n) <= writable)
+    {
+        writerIndex_ += n;
+    }
+    else // 预估偏小 溢出到spill区的部分再追加进来
+    {
+        writerIndex_ += writable;
+        append(spill, n - writable);
+    }
+    sizer->update(n, target);
+    return n;
+}
+
 // inputBuffer_.readFd表示将对端数据读到inputBuffer_中，移动writerIndex_指针
 // outputBuffer_.writeFd标示将数据写入到outputBuffer_中，从readerIndex_开始，可以写readableBytes()个字节
 ssize_t Buffer::writeFd(int fd, int *saveErrno)
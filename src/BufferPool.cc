@@ -0,0 +1,55 @@
+#include "BufferPool.h"
+
+BufferPool::BufferPool(size_t storageSize, size_t maxPooledBytes)
+    : storageSize_(storageSize)
+    , maxPooledBytes_(maxPooledBytes)
+    , pooledBytes_(0)
+    , borrowedBytes_(0)
+    , trimmedBytes_(0)
+{
+}
+
+void BufferPool::acquire(Buffer *buf)
+{
+    if (buf->hasStorage())
+    {
+        return;
+    }
+
+    std::vector<char> storage;
+    if (freeList_.empty())
+    {
+        storage.resize(storageSize_);
+    }
+    else
+    {
+        storage.swap(freeList_.back());
+        freeList_.pop_back();
+        pooledBytes_ -= storageSize_;
+    }
+    buf->swapStorage(storage);
+    borrowedBytes_ += storageSize_;
+}
+
+void BufferPool::release(Buffer *buf)
+{
+    if (!buf->hasStorage() || buf->readableBytes() != 0)
+    {
+        return;
+    }
+
+    std::vector<char> storage;
+    buf->swapStorage(storage); // 现在storage里是Buffer原来的存储 Buffer变为无存储状态
+    borrowedBytes_ -= storageSize_;
+
+    if (storage.size() == storageSize_ && storage.capacity() == storageSize_
+        && pooledBytes_ + storageSize_ <= maxPooledBytes_)
+    {
+        freeList_.push_back(std::move(storage));
+        pooledBytes_ += storageSize_;
+    }
+    else
+    {
+        trimmedBytes_ += storage.capacity(); // 扩容过或池子已满 离开作用域时释放
+    }
+}
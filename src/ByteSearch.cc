@@ -0,0 +1,214 @@
+#include <string.h>
+
+#include "ByteSearch.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BYTESEARCH_X86 1
+#endif
+
+namespace
+{
+using CRLFFunc = const char *(*)(const char *, const char *);
+using AnyFunc = const char *(*)(const char *, const char *, const char *, size_t);
+
+const char *findCRLFScalar(const char *p, const char *end)
+{
+    for (; end - p >= 2; ++p)
+    {
+        if (p[0] == '\r' && p[1] == '\n')
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// set不超过kMaxSetSize个字节 逐个比较比查表更快
+const char *findAnyScalar(const char *p, const char *end, const char *set, size_t n)
+{
+    for (; p < end; ++p)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (*p == set[i])
+            {
+                return p;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// set较大时先建一张256项的表
+const char *findAnyTable(const char *p, const char *end, const char *set)
+{
+    bool table[256] = {false};
+    for (; *set; ++set)
+    {
+        table[static_cast<unsigned char>(*set)] = true;
+    }
+    for (; p < end; ++p)
+    {
+        if (table[static_cast<unsigned char>(*p)])
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef BYTESEARCH_X86
+/**
+ * 每次比较16字节：块p中等于'\r'的位置与块p+1中等于'\n'的位置按位与 第一个置位的就是"\r\n"
+ * 读p+1时要多读一个字节 所以循环条件是剩余至少17字节 最后不足一块的部分逐字节扫描
+ **/
+const char *findCRLFSse2(const char *p, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 17)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findCRLFScalar(p, end);
+}
+
+const char *findAnySse2(const char *p, const char *end, const char *set, size_t n)
+{
+    __m128i needles[ByteSearch::kMaxSetSize];
+    for (size_t i = 0; i < n; ++i)
+    {
+        needles[i] = _mm_set1_epi8(set[i]);
+    }
+    while (end - p >= 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i hit = _mm_cmpeq_epi8(a, needles[0]);
+        for (size_t i = 1; i < n; ++i)
+        {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(a, needles[i]));
+        }
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findAnyScalar(p, end, set, n);
+}
+
+__attribute__((target("avx2")))
+const char *findCRLFAvx2(const char *p, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - p >= 33)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findCRLFSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char *findAnyAvx2(const char *p, const char *end, const char *set, size_t n)
+{
+    __m256i needles[ByteSearch::kMaxSetSize];
+    for (size_t i = 0; i < n; ++i)
+    {
+        needles[i] = _mm256_set1_epi8(set[i]);
+    }
+    while (end - p >= 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hit = _mm256_cmpeq_epi8(a, needles[0]);
+        for (size_t i = 1; i < n; ++i)
+        {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(a, needles[i]));
+        }
+        unsigned mask = _mm256_movemask_epi8(hit);
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findAnySse2(p, end, set, n);
+}
+#endif
+
+struct Impl
+{
+    CRLFFunc findCRLF;
+    AnyFunc findAny;
+};
+
+// 第一次调用时按CPU选择实现 函数内静态变量的初始化是线程安全的
+const Impl &impl()
+{
+    static const Impl selected = []() {
+#ifdef BYTESEARCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Impl{findCRLFAvx2, findAnyAvx2};
+        }
+        return Impl{findCRLFSse2, findAnySse2};
+#else
+        return Impl{findCRLFScalar, findAnyScalar};
+#endif
+    }();
+    return selected;
+}
+}
+
+const char *ByteSearch::findByte(const char *begin, const char *end, char c)
+{
+    if (begin >= end)
+    {
+        return nullptr;
+    }
+    return static_cast<const char *>(::memchr(begin, c, end - begin));
+}
+
+const char *ByteSearch::findCRLF(const char *begin, const char *end)
+{
+    if (end - begin < 2)
+    {
+        return nullptr;
+    }
+    return impl().findCRLF(begin, end);
+}
+
+const char *ByteSearch::findAny(const char *begin, const char *end, const char *set)
+{
+    size_t n = ::strlen(set);
+    if (n == 0 || begin >= end)
+    {
+        return nullptr;
+    }
+    if (n == 1)
+    {
+        return findByte(begin, end, set[0]);
+    }
+    if (n > kMaxSetSize)
+    {
+        return findAnyTable(begin, end, set);
+    }
+    return impl().findAny(begin, end, set, n);
+}
@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "ChainBuffer.h"
+#include "BlockPool.h"
+
+ChainBuffer::ChainBuffer(BlockPool *pool)
+    : pool_(pool)
+    , readable_(0)
+{
+}
+
+ChainBuffer::~ChainBuffer()
+{
+    releaseAll();
+}
+
+size_t ChainBuffer::blockSize() const
+{
+    return pool_->blockSize();
+}
+
+const char *ChainBuffer::peek() const
+{
+    if (blocks_.empty())
+    {
+        return nullptr;
+    }
+    const Block &front = blocks_.front();
+    return front.data + front.readIndex;
+}
+
+size_t ChainBuffer::peekableBytes() const
+{
+    if (blocks_.empty())
+    {
+        return 0;
+    }
+    const Block &front = blocks_.front();
+    return front.writeIndex - front.readIndex;
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+    if (len >= readable_)
+    {
+        retrieveAll();
+        return;
+    }
+    readable_ -= len;
+    while (len > 0)
+    {
+        Block &front = blocks_.front();
+        size_t n = std::min(len, front.writeIndex - front.readIndex);
+        front.readIndex += n;
+        len -= n;
+        if (front.readIndex == front.writeIndex && blocks_.size() > 1)
+        {
+            // 读完的块立即还回池子 最后一个块留着给后续的append继续写
+            pool_->deallocate(front.data);
+            blocks_.pop_front();
+        }
+    }
+}
+
+void ChainBuffer::retrieveAll()
+{
+    // 没有待处理的数据时把所有块都还回去 空闲连接不占用任何块
+    releaseAll();
+}
+
+std::string ChainBuffer::retrieveAsString(size_t len)
+{
+    len = std::min(len, readable_);
+    std::string result;
+    result.reserve(len);
+    size_t left = len;
+    for (const Block &block : blocks_)
+    {
+        if (left == 0)
+        {
+            break;
+        }
+        size_t n = std::min(left, block.writeIndex - block.readIndex);
+        result.append(block.data + block.readIndex, n);
+        left -= n;
+    }
+    retrieve(len);
+    return result;
+}
+
+void ChainBuffer::append(const char *data, size_t len)
+{
+    readable_ += len;
+    while (len > 0)
+    {
+        if (blocks_.empty() || blocks_.back().writeIndex == blockSize())
+        {
+            blocks_.push_back(Block{pool_->allocate(), 0, 0});
+        }
+        Block &back = blocks_.back();
+        size_t n = std::min(len, blockSize() - back.writeIndex);
+        ::memcpy(back.data + back.writeIndex, data, n);
+        back.writeIndex += n;
+        data += n;
+        len -= n;
+    }
+}
+
+int ChainBuffer::peekIovecs(size_t offset, size_t len, struct iovec *iov, int maxIov) const
+{
+    int cnt = 0;
+    for (const Block &block : blocks_)
+    {
+        if (cnt >= maxIov || len == 0)
+        {
+            break;
+        }
+        size_t avail = block.writeIndex - block.readIndex;
+        if (offset >= avail)
+        {
+            offset -= avail; // 跳过已经被描述过的数据
+            continue;
+        }
+        size_t n = std::min(len, avail - offset);
+        iov[cnt].iov_base = block.data + block.readIndex + offset;
+        iov[cnt].iov_len = n;
+        ++cnt;
+        len -= n;
+        offset = 0;
+    }
+    return cnt;
+}
+
+/**
+ * 从fd上读取数据：尾块剩余的空间加上最多kReadBlocks个新块组成iovec，readv直接分散读进去，
+ * 不需要栈上的临时空间，也不会有第二次拷贝；没用上的新块原样还给池子。
+ **/
+ssize_t ChainBuffer::readFd(int fd, int *saveErrno)
+{
+    struct iovec vec[kReadBlocks + 1];
+    char *fresh[kReadBlocks];
+    int iovcnt = 0;
+
+    size_t tailSpace = 0;
+    if (!blocks_.empty())
+    {
+        Block &back = blocks_.back();
+        tailSpace = blockSize() - back.writeIndex;
+        if (tailSpace > 0)
+        {
+            vec[iovcnt].iov_base = back.data + back.writeIndex;
+            vec[iovcnt].iov_len = tailSpace;
+            ++iovcnt;
+        }
+    }
+    for (size_t i = 0; i < kReadBlocks; ++i)
+    {
+        fresh[i] = pool_->allocate();
+        vec[iovcnt].iov_base = fresh[i];
+        vec[iovcnt].iov_len = blockSize();
+        ++iovcnt;
+    }
+
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+
+    size_t left = n > 0 ? static_cast<size_t>(n) : 0;
+    readable_ += left;
+    if (tailSpace > 0)
+    {
+        size_t used = std::min(left, tailSpace);
+        blocks_.back().writeIndex += used;
+        left -= used;
+    }
+    for (size_t i = 0; i < kReadBlocks; ++i)
+    {
+        if (left > 0)
+        {
+            size_t used = std::min(left, blockSize());
+            blocks_.push_back(Block{fresh[i], 0, used});
+            left -= used;
+        }
+        else
+        {
+            pool_->deallocate(fresh[i]);
+        }
+    }
+    return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int *saveErrno)
+{
+    struct iovec vec[kMaxIovecs];
+    int iovcnt = peekIovecs(0, readable_, vec, kMaxIovecs);
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+void ChainBuffer::releaseAll()
+{
+    for (const Block &block : blocks_)
+    {
+        pool_->deallocate(block.data);
+    }
+    blocks_.clear();
+    readable_ = 0;
+}
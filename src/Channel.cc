@@ -16,6 +16,7 @@ Channel::Channel(EventLoop *loop, int fd)
     , events_(0)
     , revents_(0)
     , index_(-1)
+    , edgeTriggered_(false)
     , tied_(false) {
 }
 
@@ -33,11 +34,32 @@ void Channel::tie(const std::shared_ptr<void> &obj)
 // 通知 Poller 更新当前 Channel 关注的事件类型
 void Channel::update()
 {
+    if (updateCallback_)
+    {
+        updateCallback_();          // 不在Poller中注册 由完成式I/O接管
+        return;
+    }
     loop_->updateChannel(this);     // 通过所属事件循环对象，调用 Poller 的更新方法
 }
 
+void Channel::setEdgeTriggered(bool on)
+{
+    if (edgeTriggered_ != on)
+    {
+        edgeTriggered_ = on;
+        if (!isNoneEvent())
+        {
+            update();
+        }
+    }
+}
+
 void Channel::remove()
 {
+    if (updateCallback_)
+    {
+        return;
+    }
     loop_->removeChannel(this);
 }
 
@@ -2,9 +2,19 @@
 
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
 
 Poller *Poller::newDefaultPoller(EventLoop *loop)
 {
+    if (::getenv("MUDUO_USE_IOURING"))
+    {
+        IoUringPoller *poller = new IoUringPoller(loop); // 生成io_uring的实例
+        if (poller->valid())
+        {
+            return poller;
+        }
+        delete poller; // 内核不支持或被禁用(kernel.io_uring_disabled、seccomp) 退回epoll
+    }
     if (::getenv("MUDUO_USE_POLL"))
     {
         return nullptr; // 生成poll的实例
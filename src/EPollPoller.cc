@@ -1,11 +1,26 @@
+#include <algorithm>
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/ioctl.h>
 
 #include "EPollPoller.h"
 #include "Logger.h"
 #include "Channel.h"
 
+// 旧的头文件中没有epoll忙轮询的ioctl 按内核uapi(include/uapi/linux/eventpoll.h)补上 运行时内核不支持会返回ENOTTY/EINVAL
+#ifndef EPIOCSPARAMS
+struct epoll_params
+{
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#endif
+
 const int kNew = -1;    // 表示 Channel 尚未注册到 Poller，index_ 初始化为 -1
 const int kAdded = 1;   // 表示 Channel 已经注册到 Poller
 const int kDeleted = 2; // 表示 Channel 已经从 Poller 移除
@@ -15,6 +30,7 @@ EPollPoller::EPollPoller(EventLoop *loop)
     : Poller(loop)
     , epollfd_(::epoll_create1(EPOLL_CLOEXEC)) // 创建 epoll 文件描述符
     , events_(kInitEventListSize) 
+    , lowUsagePolls_(0)
 {
     if (epollfd_ < 0)
     {
@@ -29,8 +45,12 @@ EPollPoller::~EPollPoller()
 
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    // 输出当前监听的 fd 数量
-    LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
+    // 输出当前监听的 fd 数量 忙轮询时0超时的poll非常频繁 不输出
+    if (timeoutMs != 0)
+    {
+        LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels_);
+    }
+    flushChanges();
 
     // 调用 epoll_wait 等待事件发生，events_ 存储所有发生的事件
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
@@ -41,10 +61,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
     {
         LOG_INFO("%d events happend\n", numEvents); 
         fillActiveChannels(numEvents, activeChannels);  // 将活跃事件填充到 activeChannels 列表
-        if (numEvents == events_.size()) 
-        {
-            events_.resize(events_.size() * 2);
-        }
+        adjustEventList(numEvents);
     }
     else if (numEvents == 0)
     {
@@ -70,11 +87,11 @@ void EPollPoller::updateChannel(Channel *channel)
     {
         if (index == kNew)
         {
-            int fd = channel->fd();
-            channels_[fd] = channel;
+            addChannelEntry(channel);
         }
-        else // index == kDeleted
+        else if (channel->isNoneEvent()) // 已经从epoll中删除且仍然没有关注的事件 不能再加回去 否则EPOLLHUP/EPOLLERR照样会上报
         {
+            return;
         }
         channel->set_index(kAdded);
         update(EPOLL_CTL_ADD, channel);
@@ -89,15 +106,35 @@ void EPollPoller::updateChannel(Channel *channel)
         }
         else
         {
-            update(EPOLL_CTL_MOD, channel);
+            Interest &interest = interests_[fd];
+            if (!interest.dirty)
+            {
+                interest.dirty = true;
+                changedFds_.push_back(fd);
+            }
         }
     }
 }
 
+bool EPollPoller::setBusyPoll(uint32_t usecs, uint16_t budget, bool prefer)
+{
+    epoll_params params;
+    ::memset(&params, 0, sizeof(params));
+    params.busy_poll_usecs = usecs;
+    params.busy_poll_budget = budget;
+    params.prefer_busy_poll = prefer ? 1 : 0;
+    if (::ioctl(epollfd_, EPIOCSPARAMS, &params) < 0)
+    {
+        LOG_ERROR("EPollPoller::setBusyPoll usecs=%u budget=%u errno=%d\n", usecs, budget, errno);
+        return false;
+    }
+    return true;
+}
+
 void EPollPoller::removeChannel(Channel *channel)
 {
     int fd = channel->fd();
-    channels_.erase(fd);
+    removeChannelEntry(channel);
 
     LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
 
@@ -109,6 +146,61 @@ void EPollPoller::removeChannel(Channel *channel)
     channel->set_index(kNew);
 }
 
+void EPollPoller::flushChanges()
+{
+    for (int fd : changedFds_)
+    {
+        Interest &interest = interests_[fd];
+        if (!interest.dirty) // 提交前已经DEL
+        {
+            continue;
+        }
+        interest.dirty = false;
+        Channel *channel = channels_[fd];
+        // 边沿触发时MOD会按fd当前的状态重新上报就绪：同一轮里关掉又打开读时，socket上剩下的数据要靠它再通知一次
+        if (channel->edgeTriggered() || wantedEvents(channel) != interest.registered)
+        {
+            update(EPOLL_CTL_MOD, channel);
+        }
+    }
+    changedFds_.clear();
+}
+
+uint32_t EPollPoller::wantedEvents(Channel *channel) const
+{
+    return channel->events() | (channel->edgeTriggered() ? static_cast<uint32_t>(EPOLLET) : 0u);
+}
+
+/**
+ * 按实际就绪数调整events_：填满说明还有就绪的fd没取到 下次加倍；
+ * 连续kShrinkAfterPolls次有事件的poll都用不到四分之一时减半 释放大量连接退去后留下的大数组
+ * 0个事件的poll(超时、忙轮询)不参与统计
+ **/
+void EPollPoller::adjustEventList(int numEvents)
+{
+    size_t size = events_.size();
+    if (static_cast<size_t>(numEvents) == size)
+    {
+        if (size < kMaxEventListSize)
+        {
+            events_.resize(size * 2);
+        }
+        lowUsagePolls_ = 0;
+    }
+    else if (size > kInitEventListSize && static_cast<size_t>(numEvents) < size / 4)
+    {
+        if (++lowUsagePolls_ >= kShrinkAfterPolls)
+        {
+            EventList(size / 2).swap(events_);
+            lowUsagePolls_ = 0;
+        }
+    }
+    else
+    {
+        lowUsagePolls_ = 0;
+    }
+}
+
 void EPollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels) const
 {
     for (int i = 0; i < numEvents; ++i)
@@ -126,10 +218,25 @@ void EPollPoller::update(int operation, Channel *channel)
 
     int fd = channel->fd();
 
-    event.events = channel->events();
+    event.events = wantedEvents(channel);
     event.data.fd = fd;
     event.data.ptr = channel;
 
+    if (static_cast<size_t>(fd) >= interests_.size())
+    {
+        interests_.resize(std::max(static_cast<size_t>(fd) + 1, interests_.size() * 2));
+    }
+    Interest &interest = interests_[fd];
+    if (operation == EPOLL_CTL_DEL)
+    {
+        interest.registered = 0;
+        interest.dirty = false; // changedFds_中的这一项作废 fd可能在提交前被关闭
+    }
+    else
+    {
+        interest.registered = event.events;
+    }
+
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
         if (operation == EPOLL_CTL_DEL)
@@ -3,16 +3,26 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <chrono>
+#include <algorithm>
 
 #include "EventLoop.h"
 #include "Logger.h"
 #include "Channel.h"
 #include "Poller.h"
+#include "BlockPool.h"
+#include "BufferPool.h"
+#include "PipePool.h"
+#include "ZeroCopyReaper.h"
+#include "IoUringEngine.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
 
  // 线程局部变量，记录当前线程的 EventLoop 实例
 __thread EventLoop *t_loopInThisThread = nullptr;
 
 const int kPollTimeMs = 10000;  // Poller 轮询超时时间，单位毫秒
+const int64_t kSpinGrowStartUs = 10; // 自适应自旋从0开始增长时的起点
 
 /* 创建线程之后主线程和子线程谁先运行是不确定的。
  * 通过一个eventfd在线程之间传递数据的好处是多个线程无需上锁就可以实现同步。
@@ -41,11 +51,25 @@ int createEventfd()
 EventLoop::EventLoop()
     : looping_(false)
     , quit_(false)
-    , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , timerQueue_(new TimerQueue(this))
+    , timingWheel_(new TimingWheel(this))
+    , blockPool_(new BlockPool())
+    , bufferPool_(new BufferPool())
+    , pipePool_(new PipePool())
+    , zeroCopyReaper_(new ZeroCopyReaper(this))
+    , recvSpill_(kRecvSpillSize)
+    , pendingFunctorLimit_(0)
+    , polling_(false)
+    , wakeupPending_(false)
+    , busyPoll_(false)
+    , kernelBusyPoll_(false)
+    , iteration_(0)
+    , callingIterationChecks_(false)
+    , ioUringTried_(false)
 {
     LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
     if (t_loopInThisThread)
@@ -81,7 +105,24 @@ void EventLoop::loop()
     while (!quit_)
     {
         activeChannels_.clear();
-        pollRetureTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        // 先声明要进入poll再检查队列 与queueInLoop中先入队再检查polling_配对：
+        // 要么这里看到了新回调不阻塞 要么生产者看到polling_为true负责唤醒
+        if (!busyPoll_ || !spinPoll())
+        {
+            polling_.store(true);
+            int timeoutMs = pendingFunctors_.empty() ? kPollTimeMs : 0;
+            if (busyPoll_ && timeoutMs != 0)
+            {
+                auto start = std::chrono::steady_clock::now();
+                pollRetureTime_ = poller_->poll(timeoutMs, &activeChannels_);
+                adaptSpin(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+            }
+            else
+            {
+                pollRetureTime_ = poller_->poll(timeoutMs, &activeChannels_);
+            }
+        }
+        polling_.store(false);
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生了事件 然后上报给EventLoop 通知channel处理相应的事件
@@ -94,6 +135,8 @@ void EventLoop::loop()
          * mainloop调用queueInLoop将回调加入subloop（该回调需要subloop执行 但subloop还在poller_->poll处阻塞） queueInLoop通过wakeup将subloop唤醒
          **/
         doPendingFunctors();
+        doIterationChecks();
+        ++iteration_;
     }
     LOG_INFO("EventLoop %p stop looping.\n", this);
     looping_ = false;
@@ -124,30 +167,158 @@ void EventLoop::runInLoop(Functor cb) {
     if (isInLoopThread()) {
         cb();
     } else {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
 // 将回调加入队列，并根据需要唤醒事件循环线程
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    pendingFunctors_.push(std::move(cb));
 
     /**
-     * || callingPendingFunctors的意思是 当前loop正在执行回调中 但是loop的pendingFunctors_中又加入了新的回调 需要通过wakeup写事件
-     * 唤醒相应的需要执行上面回调操作的loop的线程 让loop()下一次poller_->poll()不再阻塞（阻塞的话会延迟前一次新加入的回调的执行），然后
-     * 继续执行pendingFunctors_中的回调函数
+     * 只有loop可能阻塞在poll中时才需要写eventfd：
+     * loop线程自己入队时(包括正在执行回调时) 下一次poll之前会检查队列 不会阻塞
+     * 其它线程入队时 如果loop没有在poll 它在下一次poll之前同样会看到这个回调
+     * 多个生产者同时发现需要唤醒时 只有第一个真正写eventfd
      **/
-    // 如果当前不在事件循环线程或正在执行回调，则唤醒事件循环线程
-    if (!isInLoopThread() || callingPendingFunctors_)
+    if (polling_.load() && !wakeupPending_.exchange(true))
+    {
+        wakeup();
+    }
+}
+
+bool EventLoop::setBusyPoll(const BusyPollPolicy &policy)
+{
+    assertInLoopThread();
+    bool ok = true;
+    busyPollPolicy_ = policy;
+    busyPoll_ = policy.maxSpinUs > 0;
+    // 只有一个CPU时自旋只会抢走对端和其它线程的时间片 延迟反而升高一个数量级
+    if (busyPoll_ && ::sysconf(_SC_NPROCESSORS_ONLN) < 2)
+    {
+        LOG_ERROR("EventLoop::setBusyPoll spinning disabled: only one CPU online\n");
+        busyPoll_ = false;
+        ok = false;
+    }
+    busyPollStats_.spinUs = policy.adaptive ? std::min(busyPollStats_.spinUs, policy.maxSpinUs) : policy.maxSpinUs;
+    if (!busyPoll_)
+    {
+        busyPollStats_.spinUs = 0;
+    }
+
+    if (policy.kernelBusyPollUs > 0 || kernelBusyPoll_)
+    {
+        bool kernelOk = poller_->setBusyPoll(policy.kernelBusyPollUs, policy.kernelBudget, policy.kernelPreferBusyPoll);
+        kernelBusyPoll_ = kernelOk && policy.kernelBusyPollUs > 0;
+        ok = ok && kernelOk;
+    }
+    return ok;
+}
+
+// 自旋期间producer不会写eventfd(polling_为false) 所以每次都要检查回调队列
+bool EventLoop::spinPoll()
+{
+    int64_t spinUs = busyPollStats_.spinUs;
+    if (spinUs <= 0)
+    {
+        return false;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(spinUs);
+    do
+    {
+        pollRetureTime_ = poller_->poll(0, &activeChannels_);
+        if (!activeChannels_.empty() || !pendingFunctors_.empty())
+        {
+            ++busyPollStats_.spinHits;
+            return true;
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+    ++busyPollStats_.spinMisses;
+    return false;
+}
+
+void EventLoop::adaptSpin(int64_t blockedUs)
+{
+    if (!busyPollPolicy_.adaptive)
+    {
+        return;
+    }
+    int64_t &spinUs = busyPollStats_.spinUs;
+    if (blockedUs <= busyPollPolicy_.maxSpinUs)
+    {
+        spinUs = std::min(busyPollPolicy_.maxSpinUs, std::max(spinUs * 2, kSpinGrowStartUs));
+    }
+    else
+    {
+        spinUs /= 2;
+        if (spinUs < kSpinGrowStartUs)
+        {
+            spinUs = 0;
+        }
+    }
+}
+
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb, double slack)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0, slack);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb, double slack)
+{
+    return runAt(addTime(Timestamp::now(), delay), std::move(cb), slack);
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb, double slack)
+{
+    return timerQueue_->addTimer(std::move(cb), addTime(Timestamp::now(), interval), interval, slack);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+bool EventLoop::tryQueueInLoop(Functor cb)
+{
+    size_t limit = pendingFunctorLimit_.load(std::memory_order_relaxed);
+    if (limit > 0 && pendingFunctors_.size() >= limit)
+    {
+        return false;
+    }
+    queueInLoop(std::move(cb));
+    return true;
+}
+
+void EventLoop::addIterationCheck(IterationCheck check)
+{
+    assertInLoopThread();
+    iterationChecks_.push_back(std::move(check));
+    if (callingIterationChecks_ || !looping_) // loop()之前登记的检查 不能等第一次poll超时
     {
         wakeup();
     }
 }
 
+void EventLoop::doIterationChecks()
+{
+    if (iterationChecks_.empty())
+    {
+        return;
+    }
+    std::vector<IterationCheck> checks;
+    checks.swap(iterationChecks_); // 检查过程中新登记的检查会进入iterationChecks_ 下一轮才执行
+    callingIterationChecks_ = true;
+    for (IterationCheck &check : checks)
+    {
+        if (check())
+        {
+            iterationChecks_.push_back(std::move(check));
+        }
+    }
+    callingIterationChecks_ = false;
+}
+
 // 处理唤醒事件，读取 eventfd 数据，清除唤醒信号
 void EventLoop::handleRead()
 {
@@ -157,6 +328,7 @@ void EventLoop::handleRead()
     {
         LOG_ERROR("EventLoop::handleRead() reads %lu bytes instead of 8\n", n);
     }
+    wakeupPending_.store(false); // 之后入队的生产者如果发现loop又要阻塞 可以再次唤醒
 }
 
 // 用来唤醒loop所在线程 向wakeupFd_写一个数据 wakeupChannel就发生读事件 当前loop线程就会被唤醒
@@ -186,6 +358,21 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
+IoUringEngine *EventLoop::ioUring()
+{
+    assertInLoopThread();
+    if (!ioUringTried_)
+    {
+        ioUringTried_ = true;
+        ioUring_.reset(new IoUringEngine(this));
+        if (!ioUring_->valid())
+        {
+            ioUring_.reset();
+        }
+    }
+    return ioUring_.get();
+}
+
 void EventLoop::abortNotInLoopThread()
 {
   LOG_FATAL("EventLoop::abortNotInLoopThread - EventLoop was created in threadId = %d, current thread id = %d",
@@ -194,18 +381,11 @@ void EventLoop::abortNotInLoopThread()
 
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
-    callingPendingFunctors_ = true;
-
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_); // 交换的方式减少了锁的临界区范围 提升效率 同时避免了死锁 如果执行functor()在临界区内 且functor()中调用queueInLoop()就会产生死锁
-    }
-
-    for (const Functor &functor : functors)
+    // 只执行进入时已经在队列中的回调 执行过程中新加入的留到下一轮 避免回调不断重新入队时饿死IO事件
+    size_t count = pendingFunctors_.size();
+    Functor functor;
+    while (count-- > 0 && pendingFunctors_.pop(functor))
     {
         functor(); // 执行当前loop需要执行的回调操作
     }
-
-    callingPendingFunctors_ = false;
 }
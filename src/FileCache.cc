@@ -0,0 +1,271 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "FileCache.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+CachedFile::CachedFile(int fd, size_t size, void *map)
+    : fd_(fd)
+    , size_(size)
+    , map_(map)
+{
+}
+
+CachedFile::~CachedFile()
+{
+    if (map_)
+    {
+        ::munmap(map_, size_);
+    }
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+FileCache::FileCache(size_t maxFiles, size_t maxMappedBytes, size_t mmapThreshold)
+    : maxFiles_(maxFiles)
+    , maxMappedBytes_(maxMappedBytes)
+    , mmapThreshold_(mmapThreshold)
+    , mappedBytes_(0)
+    , hits_(0)
+    , misses_(0)
+    , inotifyFd_(-1)
+{
+}
+
+FileCache::~FileCache()
+{
+    if (inotifyChannel_)
+    {
+        inotifyChannel_->disableAll();
+        inotifyChannel_->remove();
+    }
+    if (inotifyFd_ >= 0)
+    {
+        ::close(inotifyFd_);
+    }
+}
+
+CachedFilePtr FileCache::get(const std::string &path)
+{
+    int wd = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            ++hits_;
+            return it->second.file;
+        }
+        ++misses_;
+
+        // 先加watch再打开 避免打开之后、加watch之前的修改被漏掉
+        if (inotifyFd_ >= 0)
+        {
+            wd = ::inotify_add_watch(inotifyFd_, path.c_str(),
+                                     IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF);
+        }
+    }
+    CachedFilePtr file = open(path);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file)
+    {
+        if (wd >= 0 && watches_.count(wd) == 0)
+        {
+            ::inotify_rm_watch(inotifyFd_, wd);
+        }
+        return file;
+    }
+    auto it = entries_.find(path);
+    if (it != entries_.end())
+    {
+        return it->second.file; // 其它线程已经先放进来了
+    }
+    if (wd < 0 && inotifyFd_ >= 0)
+    {
+        return file; // 打开期间启用了inotify或加watch失败 没有watch的条目无法作废 不缓存
+    }
+    lru_.push_front(path);
+    entries_[path] = Entry{file, lru_.begin(), wd};
+    if (wd >= 0)
+    {
+        watches_.emplace(wd, path);
+    }
+    if (file->mapped())
+    {
+        mappedBytes_ += file->size();
+    }
+    while ((entries_.size() > maxFiles_ || mappedBytes_ > maxMappedBytes_) && lru_.size() > 1)
+    {
+        eraseLocked(entries_.find(lru_.back()));
+    }
+    return file;
+}
+
+CachedFilePtr FileCache::open(const std::string &path) const
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return CachedFilePtr();
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return CachedFilePtr();
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *map = nullptr;
+    if (size > 0 && size <= mmapThreshold_)
+    {
+        map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            map = nullptr;
+        }
+        else
+        {
+            ::close(fd); // 映射建立后不再需要fd 不占用fd配额
+            fd = -1;
+        }
+    }
+    return std::make_shared<const CachedFile>(fd, size, map);
+}
+
+void FileCache::eraseLocked(std::unordered_map<std::string, Entry>::iterator it)
+{
+    if (it == entries_.end())
+    {
+        return;
+    }
+    Entry &entry = it->second;
+    if (entry.file->mapped())
+    {
+        mappedBytes_ -= entry.file->size();
+    }
+    lru_.erase(entry.lru);
+    if (entry.wd >= 0)
+    {
+        auto range = watches_.equal_range(entry.wd);
+        for (auto w = range.first; w != range.second; ++w)
+        {
+            if (w->second == it->first)
+            {
+                watches_.erase(w);
+                break;
+            }
+        }
+        if (watches_.count(entry.wd) == 0)
+        {
+            ::inotify_rm_watch(inotifyFd_, entry.wd);
+        }
+    }
+    entries_.erase(it); // 正在发送的连接仍持有CachedFilePtr 发完后才真正关闭/解除映射
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    eraseLocked(entries_.find(path));
+}
+
+void FileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!lru_.empty())
+    {
+        eraseLocked(entries_.find(lru_.back()));
+    }
+}
+
+bool FileCache::enableInotify(EventLoop *loop)
+{
+    if (inotifyFd_ >= 0)
+    {
+        return true;
+    }
+    int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("FileCache::enableInotify inotify_init1 error:%d\n", errno);
+        return false;
+    }
+    {
+        // 之前缓存的条目没有watch 与设置inotifyFd_在同一次加锁中清空，重新打开时再加上
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!lru_.empty())
+        {
+            eraseLocked(entries_.find(lru_.back()));
+        }
+        inotifyFd_ = fd;
+    }
+    inotifyChannel_.reset(new Channel(loop, fd));
+    inotifyChannel_->setReadCallback([this](Timestamp) { handleInotify(); });
+    inotifyChannel_->enableReading();
+    return true;
+}
+
+void FileCache::handleInotify()
+{
+    alignas(struct inotify_event) char buf[4096];
+    for (;;)
+    {
+        ssize_t n = ::read(inotifyFd_, buf, sizeof buf);
+        if (n <= 0)
+        {
+            break; // EAGAIN 事件已经读完
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (char *p = buf; p < buf + n;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            // 同一个wd上的所有路径都作废 IN_IGNORED表示watch已被内核移除 同样要作废
+            auto range = watches_.equal_range(event->wd);
+            std::vector<std::string> paths;
+            for (auto w = range.first; w != range.second; ++w)
+            {
+                paths.push_back(w->second);
+            }
+            for (const std::string &path : paths)
+            {
+                eraseLocked(entries_.find(path));
+            }
+        }
+    }
+}
+
+size_t FileCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t FileCache::mappedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mappedBytes_;
+}
+
+uint64_t FileCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t FileCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "IoUring.h"
+#include "Logger.h"
+
+IoUring::IoUring(unsigned sqEntries, unsigned cqEntries)
+    : ringFd_(-1)
+    , sqRing_(MAP_FAILED)
+    , sqRingSize_(0)
+    , cqRing_(MAP_FAILED)
+    , cqRingSize_(0)
+    , sqes_(static_cast<io_uring_sqe *>(MAP_FAILED))
+    , sqesSize_(0)
+    , sqHead_(nullptr)
+    , sqTail_(nullptr)
+    , sqMask_(0)
+    , sqEntries_(0)
+    , sqArray_(nullptr)
+    , sqeTail_(0)
+    , cqHead_(nullptr)
+    , cqTail_(nullptr)
+    , cqMask_(0)
+    , cqes_(nullptr)
+{
+    if (!setup(sqEntries, cqEntries) && ringFd_ >= 0)
+    {
+        ::close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+void IoUring::close()
+{
+    if (sqes_ != MAP_FAILED)
+    {
+        ::munmap(sqes_, sqesSize_);
+        sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = MAP_FAILED;
+    if (sqRing_ != MAP_FAILED)
+    {
+        ::munmap(sqRing_, sqRingSize_);
+        sqRing_ = MAP_FAILED;
+    }
+    if (ringFd_ >= 0)
+    {
+        ::close(ringFd_); // 关闭时内核取消所有还在进行的请求
+        ringFd_ = -1;
+    }
+}
+
+bool IoUring::setup(unsigned sqEntries, unsigned cqEntries)
+{
+    io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cqEntries;
+#ifdef IORING_SETUP_COOP_TASKRUN
+    // 完成项只在所属线程进入内核时处理 不用IPI打断正在运行的loop线程 loop每轮都会进入内核
+    params.flags |= IORING_SETUP_COOP_TASKRUN;
+#endif
+    ringFd_ = static_cast<int>(::syscall(__NR_io_uring_setup, sqEntries, &params));
+    if (ringFd_ < 0 && errno == EINVAL) // 5.19之前的内核不认识COOP_TASKRUN
+    {
+        ::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = cqEntries;
+        ringFd_ = static_cast<int>(::syscall(__NR_io_uring_setup, sqEntries, &params));
+    }
+    if (ringFd_ < 0)
+    {
+        LOG_ERROR("io_uring_setup error:%d\n", errno);
+        return false;
+    }
+    // 等待超时需要IORING_ENTER_EXT_ARG(5.11) 完成队列溢出时不丢完成项需要IORING_FEAT_NODROP(5.5)
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        LOG_ERROR("io_uring features:%#x lack EXT_ARG/NODROP\n", params.features);
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sq ring error:%d\n", errno);
+        return false;
+    }
+    cqRing_ = singleMmap ? sqRing_
+                         : ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap cq ring error:%d\n", errno);
+        return false;
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sqes error:%d\n", errno);
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqeTail_ = *sqTail_;
+
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+    {
+        enter(0, 0);
+    }
+    unsigned index = sqeTail_ & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqeTail_;
+    return sqe;
+}
+
+int IoUring::enter(unsigned waitNr, int timeoutMs)
+{
+    unsigned toSubmit = sqeTail_ - *sqTail_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void *argp = nullptr;
+    size_t argSize = 0;
+    if (waitNr > 0 && timeoutMs >= 0)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+        ::memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argSize = sizeof(arg);
+    }
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit, waitNr, flags, argp, argSize));
+}
+
+int IoUring::registerOp(unsigned opcode, void *arg, unsigned nrArgs)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, ringFd_, opcode, arg, nrArgs));
+}
@@ -0,0 +1,341 @@
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "IoUringEngine.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+
+IoUringEngine::IoUringEngine(EventLoop *loop)
+    : loop_(loop)
+    , ring_(kSqEntries, kCqEntries)
+    , valid_(false)
+    , bufRing_(static_cast<io_uring_buf *>(MAP_FAILED))
+    , bufRingSize_(0)
+    , bufTail_(0)
+    , submitScheduled_(false)
+{
+    if (!ring_.valid() || !setupBuffers())
+    {
+        LOG_ERROR("IoUringEngine unavailable, connections keep using the poller\n");
+        return;
+    }
+    valid_ = true;
+    ringChannel_.reset(new Channel(loop_, ring_.fd()));
+    ringChannel_->setReadCallback(std::bind(&IoUringEngine::handleCompletions, this));
+    ringChannel_->enableReading(); // 完成队列非空时ring fd可读
+}
+
+/**
+ * 释放顺序不能交给成员的声明顺序：还挂着的multishot recv随时可能从缓冲区环中取一块接收缓冲区写入数据，
+ * 必须先让所有请求结束并关闭ring，之后才能释放缓冲区环和接收缓冲区
+ **/
+IoUringEngine::~IoUringEngine()
+{
+    if (ringChannel_)
+    {
+        ringChannel_->disableAll();
+        ringChannel_->remove();
+    }
+    bool drained = !valid_ || drainRequests();
+    ring_.close();
+    if (!drained)
+    {
+        // 还有请求没结束 内核仍可能写入接收缓冲区 宁可泄漏也不能释放
+        LOG_ERROR("IoUringEngine requests still in flight at exit, receive buffers leaked\n");
+        buffers_.release();
+        return;
+    }
+    if (bufRing_ != MAP_FAILED)
+    {
+        ::munmap(bufRing_, bufRingSize_);
+        bufRing_ = static_cast<io_uring_buf *>(MAP_FAILED);
+    }
+    buffers_.reset();
+}
+
+bool IoUringEngine::drainRequests()
+{
+    size_t active = 0;
+    for (uint32_t index = 0; index < requests_.size(); ++index)
+    {
+        Request &req = requests_[index];
+        if (req.active)
+        {
+            // 不经过cancel：scheduleSubmit会唤醒正在析构的loop 这里直接提交
+            ++active;
+            req.discarded = true;
+            io_uring_sqe *sqe = ring_.getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = (static_cast<uint64_t>(req.generation) << 32) | index;
+            sqe->user_data = kInternalTag;
+        }
+    }
+    // 被丢弃的请求在最后一个完成项到达时释放 每次最多等kDrainWaitMs
+    for (int round = 0; active > 0 && round < kDrainRounds; ++round)
+    {
+        if (ring_.enter(1, kDrainWaitMs) < 0 && errno != EINTR && errno != ETIME && errno != EBUSY)
+        {
+            LOG_ERROR("IoUringEngine::drainRequests io_uring_enter error:%d\n", errno);
+            return false;
+        }
+        handleCompletions();
+        active = 0;
+        for (const Request &req : requests_)
+        {
+            active += req.active ? 1 : 0;
+        }
+    }
+    return active == 0;
+}
+
+bool IoUringEngine::setupBuffers()
+{
+    bufRingSize_ = kBufferCount * sizeof(io_uring_buf);
+    void *mem = ::mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        LOG_ERROR("IoUringEngine mmap buffer ring error:%d\n", errno);
+        return false;
+    }
+    bufRing_ = static_cast<io_uring_buf *>(mem);
+
+    io_uring_buf_reg reg;
+    ::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+    reg.ring_entries = kBufferCount;
+    reg.bgid = kBufferGroup;
+    if (ring_.registerOp(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        LOG_ERROR("IoUringEngine register buffer ring error:%d\n", errno);
+        return false;
+    }
+
+    buffers_.reset(new char[kBufferCount * kBufferSize]);
+    for (unsigned bid = 0; bid < kBufferCount; ++bid)
+    {
+        recycleBuffer(static_cast<uint16_t>(bid));
+    }
+    return true;
+}
+
+void IoUringEngine::recycleBuffer(uint16_t bid)
+{
+    io_uring_buf &buf = bufRing_[bufTail_ & (kBufferCount - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(bufferData(bid));
+    buf.len = static_cast<uint32_t>(kBufferSize);
+    buf.bid = bid;
+    ++bufTail_;
+    __atomic_store_n(&bufRing_[0].resv, bufTail_, __ATOMIC_RELEASE);
+}
+
+IoUringEngine::RequestId IoUringEngine::prepare(io_uring_sqe **sqe, Callback cb)
+{
+    uint32_t index;
+    if (!freeRequests_.empty())
+    {
+        index = freeRequests_.back();
+        freeRequests_.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(requests_.size());
+        requests_.emplace_back();
+    }
+    Request &req = requests_[index];
+    req.callback = std::move(cb);
+    req.active = true;
+    req.discarded = false;
+
+    RequestId id = (static_cast<uint64_t>(req.generation) << 32) | index;
+    *sqe = ring_.getSqe();
+    (*sqe)->user_data = id;
+    scheduleSubmit();
+    return id;
+}
+
+void IoUringEngine::release(uint32_t index)
+{
+    Request &req = requests_[index];
+    req.active = false;
+    if (++req.generation == 0)
+    {
+        req.generation = 1;
+    }
+    freeRequests_.push_back(index);
+}
+
+IoUringEngine::RequestId IoUringEngine::recvMultishot(int fd, Callback cb)
+{
+    io_uring_sqe *sqe;
+    RequestId id = prepare(&sqe, std::move(cb));
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    return id;
+}
+
+IoUringEngine::RequestId IoUringEngine::acceptMultishot(int fd, Callback cb)
+{
+    io_uring_sqe *sqe;
+    RequestId id = prepare(&sqe, std::move(cb));
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    return id;
+}
+
+IoUringEngine::RequestId IoUringEngine::sendmsg(int fd, const struct msghdr *msg, Callback cb)
+{
+    io_uring_sqe *sqe;
+    RequestId id = prepare(&sqe, std::move(cb));
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL; // 对端已关闭时返回-EPIPE 由连接的读端完成项去关闭
+    return id;
+}
+
+IoUringEngine::RequestId IoUringEngine::pollAdd(int fd, uint32_t events, Callback cb)
+{
+    io_uring_sqe *sqe;
+    RequestId id = prepare(&sqe, std::move(cb));
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    sqe->poll32_events = events;
+    return id;
+}
+
+void IoUringEngine::cancel(RequestId id, bool discard)
+{
+    uint32_t index = static_cast<uint32_t>(id & 0xffffffffu);
+    if (id == 0 || index >= requests_.size())
+    {
+        return;
+    }
+    Request &req = requests_[index];
+    if (!req.active || req.generation != static_cast<uint32_t>(id >> 32))
+    {
+        return; // 已经结束
+    }
+    req.discarded = req.discarded || discard;
+    io_uring_sqe *sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = id;
+    sqe->user_data = kInternalTag;
+    scheduleSubmit();
+}
+
+void IoUringEngine::runBeforeSubmit(Task cb)
+{
+    beforeSubmit_.push_back(std::move(cb));
+    scheduleSubmit();
+}
+
+void IoUringEngine::scheduleSubmit()
+{
+    if (!submitScheduled_)
+    {
+        submitScheduled_ = true;
+        loop_->addIterationCheck([this]() {
+            submit();
+            return false;
+        });
+    }
+}
+
+void IoUringEngine::submit()
+{
+    // 提交时就能完成的请求(如socket有空间时的sendmsg)在io_uring_enter返回时已经有完成项，在这里直接收割，
+    // 不用再等一轮poll；收割中产生的新提交项在同一次检查中继续提交 最多kMaxSubmitRounds轮
+    for (int round = 0; round < kMaxSubmitRounds; ++round)
+    {
+        // 回调里可能继续登记 交换出来再执行
+        std::vector<Task> tasks;
+        tasks.swap(beforeSubmit_);
+        for (Task &task : tasks)
+        {
+            task();
+        }
+        if (ring_.pendingSubmissions() == 0)
+        {
+            break;
+        }
+        ++stats_.submits;
+        if (ring_.enter(0, 0) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        {
+            LOG_ERROR("IoUringEngine::submit io_uring_enter error:%d\n", errno);
+            break;
+        }
+        if (!ring_.hasCompletions())
+        {
+            break;
+        }
+        handleCompletions();
+    }
+    submitScheduled_ = false;
+    if (!beforeSubmit_.empty() || ring_.pendingSubmissions() > 0)
+    {
+        scheduleSubmit();
+    }
+}
+
+void IoUringEngine::handleCompletions()
+{
+    ring_.reap([this](const io_uring_cqe &cqe) { dispatch(cqe); });
+}
+
+void IoUringEngine::dispatch(const io_uring_cqe &cqe)
+{
+    ++stats_.completions;
+    if (cqe.res == -ENOBUFS)
+    {
+        ++stats_.noBuffers;
+    }
+    if (cqe.user_data == kInternalTag)
+    {
+        return;
+    }
+    uint32_t index = static_cast<uint32_t>(cqe.user_data & 0xffffffffu);
+    Request *req = index < requests_.size() ? &requests_[index] : nullptr;
+    bool live = req != nullptr && req->active && req->generation == static_cast<uint32_t>(cqe.user_data >> 32);
+    if (!live || req->discarded)
+    {
+        if (cqe.flags & IORING_CQE_F_BUFFER)
+        {
+            recycleBuffer(bufferId(cqe.flags));
+        }
+        if (live && !(cqe.flags & IORING_CQE_F_MORE))
+        {
+            req->callback = nullptr;
+            release(index);
+        }
+        return;
+    }
+
+    if (cqe.flags & IORING_CQE_F_MORE)
+    {
+        req->callback(cqe.res, cqe.flags);
+    }
+    else
+    {
+        // 最后一个完成项：先释放请求 回调里重新提交时可以复用这个位置 回调持有的对象在回调执行完后才释放
+        Callback cb = std::move(req->callback);
+        req->callback = nullptr;
+        release(index);
+        cb(cqe.res, cqe.flags);
+    }
+}
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <errno.h>
+#include <endian.h>
+
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+const int kNew = -1;    // 表示 Channel 尚未注册到 Poller，index_ 初始化为 -1
+const int kAdded = 1;   // 表示 Channel 已经注册到 Poller
+const int kDeleted = 2; // 表示 Channel 已经从 Poller 移除
+
+namespace
+{
+// poll32_events在大端机器上需要交换高低16位 与liburing的io_uring_prep_poll_add相同
+uint32_t pollMask(uint32_t events)
+{
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    return events;
+}
+} // namespace
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ring_(kSqEntries, kCqEntries)
+    , nextSeq_(0)
+{
+    if (!ring_.valid())
+    {
+        LOG_ERROR("IoUringPoller: io_uring unavailable, fall back to epoll\n");
+    }
+}
+
+IoUringPoller::~IoUringPoller()
+{
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    // 输出当前监听的 fd 数量 忙轮询时0超时的poll非常频繁 不输出
+    if (timeoutMs != 0)
+    {
+        LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels_);
+    }
+
+    flushChanges();
+    // 完成队列里已经有完成项时只提交不等待
+    int ret = ring_.enter(ring_.hasCompletions() || timeoutMs == 0 ? 0 : 1, timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    size_t before = activeChannels->size();
+    reapCompletions(activeChannels);
+    size_t numEvents = activeChannels->size() - before;
+    if (numEvents > 0)
+    {
+        LOG_INFO("%lu events happend\n", numEvents);
+    }
+    else if (ret >= 0 || saveErrno == ETIME)
+    {
+        LOG_DEBUG("%s timeout!\n", __FUNCTION__); // 超时无事件发生
+    }
+    // EBUSY/EAGAIN是完成队列溢出、内核暂时不能接收新的提交项 收割完成项后下次再提交
+    if (ret < 0 && saveErrno != ETIME && saveErrno != EINTR && saveErrno != EBUSY && saveErrno != EAGAIN)
+    {
+        errno = saveErrno;
+        LOG_ERROR("IoUringPoller::poll() error!");
+    }
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, channel->fd(), channel->events(), index);
+
+    if (index == kNew || index == kDeleted)
+    {
+        if (index == kNew)
+        {
+            addChannelEntry(channel);
+        }
+        else if (channel->isNoneEvent())
+        {
+            return;
+        }
+        channel->set_index(kAdded);
+        markDirty(channel->fd());
+    }
+    else
+    {
+        if (channel->isNoneEvent())
+        {
+            disarm(channel->fd());
+            channel->set_index(kDeleted);
+        }
+        else
+        {
+            markDirty(channel->fd());
+        }
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    removeChannelEntry(channel);
+
+    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    if (channel->index() == kAdded)
+    {
+        disarm(fd);
+    }
+    channel->set_index(kNew);
+}
+
+IoUringPoller::Watch &IoUringPoller::watchOf(int fd)
+{
+    size_t index = static_cast<size_t>(fd);
+    if (index >= watches_.size())
+    {
+        watches_.resize(std::max(index + 1, watches_.size() * 2));
+    }
+    return watches_[index];
+}
+
+void IoUringPoller::markDirty(int fd)
+{
+    Watch &watch = watchOf(fd);
+    if (!watch.dirty)
+    {
+        watch.dirty = true;
+        changedFds_.push_back(fd);
+    }
+}
+
+// 与EPollPoller相同 一轮中来回切换的关注事件合并 水平触发且净效果为空时不产生提交项
+void IoUringPoller::flushChanges()
+{
+    for (int fd : changedFds_)
+    {
+        Watch &watch = watches_[fd];
+        if (!watch.dirty) // 提交前已经移除
+        {
+            continue;
+        }
+        watch.dirty = false;
+        Channel *channel = channels_[fd];
+        if (channel == nullptr || channel->index() != kAdded)
+        {
+            continue;
+        }
+        // 边沿触发的Channel每次改动都重新挂上：旧的multishot poll只在fd再次被唤醒时完成，
+        // 新挂的poll会先检查当前状态，同一轮里关掉又打开读时socket上剩下的数据要靠它再通知一次
+        if (watch.userData != 0 && !watch.multishot && !channel->edgeTriggered() &&
+            watch.armedEvents == static_cast<uint32_t>(channel->events()))
+        {
+            continue;
+        }
+        arm(fd, channel);
+    }
+    changedFds_.clear();
+}
+
+void IoUringPoller::arm(int fd, Channel *channel)
+{
+    disarm(fd); // 关注事件变了 先撤掉旧的请求 同一批提交中POLL_REMOVE在POLL_ADD之前
+
+    Watch &watch = watches_[fd];
+    if (++nextSeq_ == 0)
+    {
+        nextSeq_ = 1;
+    }
+    watch.userData = (static_cast<uint64_t>(nextSeq_) << 32) | static_cast<uint32_t>(fd);
+    watch.armedEvents = static_cast<uint32_t>(channel->events());
+    watch.multishot = channel->edgeTriggered();
+
+    io_uring_sqe *sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = pollMask(watch.armedEvents);
+    sqe->len = watch.multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = watch.userData;
+}
+
+/**
+ * 撤掉fd上挂着的poll 提交项在下次poll时才提交
+ * 期间fd即使被关闭、复用也没有关系：旧请求持有的是文件的引用，新fd上的请求序号不同，旧请求的完成项会被丢弃
+ **/
+void IoUringPoller::disarm(int fd)
+{
+    Watch &watch = watchOf(fd);
+    if (watch.userData != 0)
+    {
+        io_uring_sqe *sqe = ring_.getSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = watch.userData;
+        sqe->user_data = kRemoveTag;
+        watch.userData = 0;
+    }
+    watch.armedEvents = 0;
+    watch.dirty = false;
+}
+
+void IoUringPoller::reapCompletions(ChannelList *activeChannels)
+{
+    ring_.reap([this](const io_uring_cqe &cqe) {
+        if (cqe.user_data == kRemoveTag)
+        {
+            return;
+        }
+        int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        if (static_cast<size_t>(fd) >= watches_.size() || watches_[fd].userData != cqe.user_data)
+        {
+            return; // 已经撤掉或换掉的请求
+        }
+        Watch &watch = watches_[fd];
+        if (!(cqe.flags & IORING_CQE_F_MORE)) // 一次性poll已完成 或multishot被内核终止
+        {
+            watch.userData = 0;
+            if (cqe.res >= 0)
+            {
+                markDirty(fd); // 仍然关注时下次poll重新挂上
+            }
+        }
+        if (cqe.res < 0)
+        {
+            LOG_ERROR("IoUringPoller poll fd=%d error:%d\n", fd, -cqe.res);
+            return;
+        }
+        if (watch.revents == 0)
+        {
+            activeFds_.push_back(fd);
+        }
+        watch.revents |= cqe.res;
+    });
+
+    for (int fd : activeFds_)
+    {
+        Watch &watch = watches_[fd];
+        Channel *channel = channels_[fd];
+        channel->set_revents(watch.revents);
+        activeChannels->push_back(channel);
+        watch.revents = 0;
+    }
+    activeFds_.clear();
+}
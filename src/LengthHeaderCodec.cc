@@ -0,0 +1,50 @@
+#include "LengthHeaderCodec.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+LengthHeaderCodec::LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameSize)
+    : frameCallback_(cb)
+    , maxFrameSize_(maxFrameSize)
+{
+}
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    while (buf->readableBytes() >= kHeaderLen)
+    {
+        int32_t len = buf->peekInt32();
+        if (len < 0 || static_cast<size_t>(len) > maxFrameSize_)
+        {
+            LOG_ERROR("LengthHeaderCodec::onMessage [%s] invalid frame length %d\n", conn->name().c_str(), len);
+            conn->shutdown();
+            break;
+        }
+        if (buf->readableBytes() < kHeaderLen + len)
+        {
+            break; // 帧还没收全
+        }
+        buf->retrieve(kHeaderLen);
+        frameCallback_(conn, std::string_view(buf->peek(), len), receiveTime);
+        buf->retrieve(len);
+    }
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf)
+{
+    if (buf->prependableBytes() < kHeaderLen)
+    {
+        // 调用者已经用prepend占满了prepend区 只能把数据重新排一遍
+        std::string body = buf->retrieveAllAsString();
+        buf->append(body.data(), body.size());
+    }
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+    conn->send(buf);
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, std::string_view message)
+{
+    Buffer buf(message.size());
+    buf.append(message.data(), message.size());
+    send(conn, &buf);
+}
@@ -0,0 +1,225 @@
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <algorithm>
+
+#include "OutputQueue.h"
+#include "BufferPool.h"
+#include "Payload.h"
+#include "Logger.h"
+
+OutputQueue::OutputQueue()
+    : bytes_(0)
+    , bufferPool_(nullptr)
+{
+}
+
+OutputQueue::~OutputQueue()
+{
+}
+
+void OutputQueue::useChainBuffer(BlockPool *pool)
+{
+    if (!chain_)
+    {
+        chain_.reset(new ChainBuffer(pool));
+    }
+}
+
+void OutputQueue::setBufferPool(BufferPool *pool)
+{
+    bufferPool_ = pool;
+    std::vector<char> storage;
+    buffer_.swapStorage(storage); // 丢掉构造时分配的初始存储
+}
+
+void OutputQueue::initBuffer(size_t initialSize, double growthFactor)
+{
+    buffer_ = Buffer(initialSize);
+    buffer_.setGrowthFactor(growthFactor);
+}
+
+void OutputQueue::shrinkBuffer(size_t reserve)
+{
+    if (buffer_.hasStorage() && !bufferPool_)
+    {
+        buffer_.shrink(reserve);
+    }
+}
+
+void OutputQueue::append(const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    if (segments_.empty() || segments_.back().payload || segments_.back().fileFd >= 0)
+    {
+        segments_.push_back(Segment{PayloadPtr(), 0, len, -1, nullptr});
+    }
+    else
+    {
+        segments_.back().length += len; // 相邻的拷贝段合并 它们在字节缓冲区里本来就是连续的
+    }
+    bytes_ += len;
+
+    if (chain_)
+    {
+        chain_->append(data, len); // 只会在链尾挂新块 已缓存的数据不会被搬移
+    }
+    else
+    {
+        if (bufferPool_)
+        {
+            bufferPool_->acquire(&buffer_);
+        }
+        buffer_.append(data, len);
+    }
+}
+
+void OutputQueue::append(const PayloadPtr &payload, size_t offset)
+{
+    if (offset >= payload->size())
+    {
+        return;
+    }
+    size_t len = payload->size() - offset;
+    segments_.push_back(Segment{payload, offset, len, -1, nullptr});
+    bytes_ += len;
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t count, std::shared_ptr<const void> owner)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    segments_.push_back(Segment{PayloadPtr(), static_cast<size_t>(offset), count, fd, std::move(owner)});
+    bytes_ += count;
+}
+
+PayloadPtr OutputQueue::frontPayload(size_t *offset, size_t *length) const
+{
+    if (segments_.empty() || !segments_.front().payload)
+    {
+        return PayloadPtr();
+    }
+    const Segment &seg = segments_.front();
+    *offset = seg.offset;
+    *length = seg.length;
+    return seg.payload;
+}
+
+int OutputQueue::fillIovecs(struct iovec *iov, int maxIov) const
+{
+    int cnt = 0;
+    size_t copied = 0; // 已经描述过的拷贝段字节数 即下一个拷贝段在字节缓冲区中的偏移
+    for (const Segment &seg : segments_)
+    {
+        if (cnt >= maxIov || seg.fileFd >= 0)
+        {
+            break;
+        }
+        if (seg.payload)
+        {
+            iov[cnt].iov_base = const_cast<char *>(seg.payload->data() + seg.offset);
+            iov[cnt].iov_len = seg.length;
+            ++cnt;
+        }
+        else if (chain_)
+        {
+            cnt += chain_->peekIovecs(copied, seg.length, iov + cnt, maxIov - cnt);
+            copied += seg.length;
+        }
+        else
+        {
+            iov[cnt].iov_base = const_cast<char *>(buffer_.peek() + copied);
+            iov[cnt].iov_len = seg.length;
+            ++cnt;
+            copied += seg.length;
+        }
+    }
+    return cnt;
+}
+
+ssize_t OutputQueue::writeFd(int fd, int *saveErrno)
+{
+    while (!segments_.empty() && segments_.front().fileFd >= 0)
+    {
+        Segment &seg = segments_.front();
+        off_t offset = static_cast<off_t>(seg.offset);
+        ssize_t n = ::sendfile(fd, seg.fileFd, &offset, seg.length);
+        if (n != 0)
+        {
+            if (n < 0)
+            {
+                *saveErrno = errno;
+            }
+            return n;
+        }
+        // 文件比登记的区间短 剩下的部分永远发不出去 丢掉这一段
+        LOG_ERROR("OutputQueue::writeFd file fd=%d ended %zu bytes early\n", seg.fileFd, seg.length);
+        bytes_ -= seg.length;
+        segments_.pop_front();
+    }
+    if (segments_.empty())
+    {
+        return 0;
+    }
+
+    struct iovec vec[kMaxIovecs];
+    int iovcnt = fillIovecs(vec, kMaxIovecs);
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+void OutputQueue::retrieve(size_t len)
+{
+    len = std::min(len, bytes_);
+    bytes_ -= len;
+    while (len > 0)
+    {
+        Segment &seg = segments_.front();
+        size_t n = std::min(len, seg.length);
+        if (seg.payload || seg.fileFd >= 0)
+        {
+            seg.offset += n;
+        }
+        else if (chain_)
+        {
+            chain_->retrieve(n);
+        }
+        else
+        {
+            buffer_.retrieve(n);
+        }
+        seg.length -= n;
+        len -= n;
+        if (seg.length == 0)
+        {
+            segments_.pop_front(); // 引用段发送完毕 释放对Payload的引用
+        }
+    }
+    if (bufferPool_)
+    {
+        bufferPool_->release(&buffer_); // 拷贝段都发完了就把存储还回去
+    }
+}
+
+void OutputQueue::releaseAll()
+{
+    segments_.clear();
+    bytes_ = 0;
+    if (chain_)
+    {
+        chain_->releaseAll();
+    }
+    buffer_.retrieveAll();
+    if (bufferPool_)
+    {
+        bufferPool_->release(&buffer_);
+    }
+}
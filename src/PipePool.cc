@@ -0,0 +1,67 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "PipePool.h"
+#include "Logger.h"
+
+PipePool::PipePool(size_t pipeSize, size_t maxFreePipes)
+    : pipeSize_(pipeSize)
+    , maxFreePipes_(maxFreePipes)
+{
+}
+
+PipePool::~PipePool()
+{
+    for (const Pipe &pipe : freeList_)
+    {
+        closePipe(pipe);
+    }
+}
+
+PipePool::Pipe PipePool::acquire()
+{
+    if (!freeList_.empty())
+    {
+        Pipe pipe = freeList_.back();
+        freeList_.pop_back();
+        return pipe;
+    }
+
+    int fds[2];
+    Pipe pipe;
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("PipePool::acquire pipe2 error:%d\n", errno);
+        return pipe;
+    }
+    pipe.readFd = fds[0];
+    pipe.writeFd = fds[1];
+    // 设置失败(超过/proc/sys/fs/pipe-max-size)时保持默认容量
+    ::fcntl(pipe.writeFd, F_SETPIPE_SZ, static_cast<int>(pipeSize_));
+    int capacity = ::fcntl(pipe.writeFd, F_GETPIPE_SZ);
+    pipe.capacity = capacity > 0 ? capacity : 4096;
+    return pipe;
+}
+
+void PipePool::release(const Pipe &pipe, bool empty)
+{
+    if (!pipe.valid())
+    {
+        return;
+    }
+    if (empty && freeList_.size() < maxFreePipes_)
+    {
+        freeList_.push_back(pipe);
+    }
+    else
+    {
+        closePipe(pipe);
+    }
+}
+
+void PipePool::closePipe(const Pipe &pipe)
+{
+    ::close(pipe.readFd);
+    ::close(pipe.writeFd);
+}
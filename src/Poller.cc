@@ -1,13 +1,40 @@
+#include <algorithm>
+
 #include "Poller.h"
 #include "Channel.h"
 
 Poller::Poller(EventLoop *loop)
-    : ownerLoop_(loop)
+    : numChannels_(0)
+    , ownerLoop_(loop)
 {
 }
 
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    size_t fd = static_cast<size_t>(channel->fd());
+    return fd < channels_.size() && channels_[fd] == channel;
+}
+
+void Poller::addChannelEntry(Channel *channel)
+{
+    size_t fd = static_cast<size_t>(channel->fd());
+    if (fd >= channels_.size())
+    {
+        channels_.resize(std::max(fd + 1, channels_.size() * 2), nullptr);
+    }
+    if (channels_[fd] == nullptr)
+    {
+        ++numChannels_;
+    }
+    channels_[fd] = channel;
+}
+
+void Poller::removeChannelEntry(Channel *channel)
+{
+    size_t fd = static_cast<size_t>(channel->fd());
+    if (fd < channels_.size() && channels_[fd] != nullptr)
+    {
+        channels_[fd] = nullptr;
+        --numChannels_;
+    }
 }
\ No newline at end of file
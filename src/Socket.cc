@@ -9,6 +9,10 @@
 #include "Logger.h"
 #include "InetAddress.h"
 
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
 Socket::~Socket()
 {
     ::close(sockfd_);
@@ -90,4 +94,18 @@ void Socket::setKeepAlive(bool on)
     // 这对于检测网络中失效的对等方非常有用。
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
-}
\ No newline at end of file
+}
+
+void Socket::setTcpCork(bool on)
+{
+    // TCP_CORK 打开期间不发送不满一个MSS的报文 关闭时把攒下的数据一起发出
+    int optval = on ? 1 : 0;
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    // SO_ZEROCOPY 允许之后的send带上MSG_ZEROCOPY 内核直接引用用户页而不拷贝 (Linux 4.14+)
+    int optval = on ? 1 : 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) == 0;
+}
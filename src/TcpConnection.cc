@@ -6,14 +6,27 @@
 #include <string.h>
 #include <netinet/tcp.h>
 #include <sys/sendfile.h>
+#include <limits.h> // for IOV_MAX
 #include <fcntl.h> // for open
 #include <unistd.h> // for close
+#include <netinet/in.h>
+#include <fcntl.h> // for splice
+#include <poll.h>
 
 #include "TcpConnection.h"
 #include "Logger.h"
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "BlockPool.h"
+#include "BufferPool.h"
+#include "Payload.h"
+#include "FileCache.h"
+#include "IoUringEngine.h"
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -38,6 +51,30 @@ TcpConnection::TcpConnection(EventLoop *loop,
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64 * 1024 * 1024) // 64M
+    , bufferPool_(nullptr)
+    , adaptiveRead_(false)
+    , iterationCheckRegistered_(false)
+    , lastActiveIteration_(0)
+    , inputOverflowed_(false)
+    , outputOverflowed_(false)
+    , zeroCopyThreshold_(0)
+    , zeroCopyNextId_(0)
+    , relayPipeBytes_(0)
+    , relayReadEof_(false)
+    , relayWriteShut_(false)
+    , autoCork_(false)
+    , tcpCork_(false)
+    , corkFlushPending_(false)
+    , edgeTriggered_(false)
+    , edgeBudget_(kDefaultEdgeBudget)
+    , edgeReadPending_(false)
+    , edgeWritePending_(false)
+    , useIoUring_(false)
+    , uring_(nullptr)
+    , recvRequest_(0)
+    , sendRequest_(0)
+    , sendPrepPending_(false)
+    , inputUndelivered_(false)
 {
     // 下面给channel设置相应的回调函数 poller给channel通知感兴趣的事件发生了 channel会回调相应的回调函数
     channel_->setReadCallback(
@@ -70,213 +107,1366 @@ void TcpConnection::send(const std::string &buf)
         }
         else
         {
-            // 否则将发送操作投递到事件循环线程中执行
+            // 否则将发送操作投递到事件循环线程中执行 调用者的buf返回后就可能失效 只能拷贝一份交过去
             loop_->runInLoop(
-                std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), Payload::create(buf)));
         }
     }
 }
 
-/**
- * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
- **/
-void TcpConnection::sendInLoop(const void *data, size_t len)
+void TcpConnection::send(std::string &&buf)
 {
-    ssize_t nwrote = 0;
-    size_t remaining = len;
-    bool faultError = false;
+    if (state_ == kConnected)
+    {
+        // 接管buf的存储 直接写不完的部分在输出队列中以引用的方式保存 无论在哪个线程调用都不拷贝数据
+        PayloadPtr payload = Payload::create(std::move(buf));
+        if (loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), std::move(payload)));
+        }
+    }
+}
 
-    if (state_ == kDisconnected) // 之前调用过该connection的shutdown 不能再进行发送了
+void TcpConnection::send(Buffer &&buf)
+{
+    if (state_ == kConnected)
     {
-        LOG_ERROR("disconnected, give up writing");
+        std::shared_ptr<const Buffer> owner = std::make_shared<const Buffer>(std::move(buf));
+        PayloadPtr payload = Payload::wrap(owner->peek(), owner->readableBytes(), owner);
+        if (loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), std::move(payload)));
+        }
     }
+}
 
-    // 表示channel_第一次开始写数据或者缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+void TcpConnection::send(std::unique_ptr<char[]> data, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        std::shared_ptr<const char[]> owner(std::move(data));
+        PayloadPtr payload = Payload::wrap(owner.get(), len, owner);
+        if (loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), std::move(payload)));
+        }
+    }
+}
+
+void TcpConnection::send(const PayloadPtr &payload)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            // 函数对象持有payload的引用 不用担心数据在投递期间被释放
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), payload));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            // buf属于调用者 跨线程时只能拷贝一份交给loop线程
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), Payload::create(buf->retrieveAllAsString())));
+        }
+    }
+}
+
+void TcpConnection::send(std::span<const std::string_view> slices)
+{
+    static const size_t kStackSlices = 16;
+    struct iovec stackVec[kStackSlices];
+    std::vector<struct iovec> heapVec;
+    struct iovec *vec = stackVec;
+    if (slices.size() > kStackSlices)
+    {
+        heapVec.resize(slices.size());
+        vec = heapVec.data();
+    }
+    for (size_t i = 0; i < slices.size(); ++i)
     {
-        nwrote = ::write(channel_->fd(), data, len);
-        if (nwrote >= 0)
+        vec[i].iov_base = const_cast<char *>(slices[i].data());
+        vec[i].iov_len = slices[i].size();
+    }
+    send(std::span<const struct iovec>(vec, slices.size()));
+}
+
+void TcpConnection::send(std::span<const struct iovec> slices)
+{
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendSlicesInLoop(slices.data(), slices.size());
+        }
+        else
         {
-            remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
+            // 调用者的内存在返回后就可能失效 跨线程只能拼成一份拷贝
+            std::string data;
+            for (const struct iovec &slice : slices)
             {
-                // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
-                loop_->queueInLoop(
-                    std::bind(writeCompleteCallback_, shared_from_this()));
+                data.append(static_cast<const char *>(slice.iov_base), slice.iov_len);
             }
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendPayloadInLoop, shared_from_this(), Payload::create(std::move(data))));
         }
-        else // nwrote < 0
+    }
+}
+
+void TcpConnection::sendSlicesInLoop(const struct iovec *slices, size_t count)
+{
+    size_t nwrote = 0;
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += slices[i].iov_len;
+    }
+    if (canWriteDirectly())
+    {
+        // 超过IOV_MAX的段这次不写 留给下面拷贝进输出队列 传total保证不会提前触发写完成回调
+        int iovcnt = static_cast<int>(std::min<size_t>(count, IOV_MAX));
+        nwrote = writeDirectly(slices, iovcnt, total, &faultError);
+    }
+
+    if (!faultError && nwrote < total)
+    {
+        checkHighWaterMark(total - nwrote);
+        size_t skip = nwrote;
+        for (size_t i = 0; i < count; ++i)
         {
-            nwrote = 0;
-            if (errno != EWOULDBLOCK) // EWOULDBLOCK表示非阻塞情况下没有数据后的正常返回 等同于EAGAIN
+            const char *data = static_cast<const char *>(slices[i].iov_base);
+            size_t len = slices[i].iov_len;
+            if (skip >= len)
             {
-                LOG_ERROR("TcpConnection::sendInLoop");
-                if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE RESET
-                {
-                    faultError = true;
-                }
+                skip -= len;
+                continue;
             }
+            outputQueue_.append(data + skip, len - skip); // 相邻的拷贝段在输出队列里会合并
+            skip = 0;
         }
+        scheduleWrite();
+        checkOutputLimit();
+    }
+    noteBufferActivity();
+}
+
+/**
+ * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
+ **/
+void TcpConnection::sendInLoop(const void *data, size_t len)
+{
+    size_t nwrote = 0;
+    bool faultError = false;
+
+    if (state_ == kDisconnected) // 之前调用过该connection的shutdown 不能再进行发送了
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    // 表示channel_第一次开始写数据或者缓冲区没有待发送数据
+    if (canWriteDirectly())
+    {
+        struct iovec vec;
+        vec.iov_base = const_cast<void *>(data);
+        vec.iov_len = len;
+        nwrote = writeDirectly(&vec, 1, len, &faultError);
     }
     /**
      * 说明当前这一次write并没有把数据全部发送出去 剩余的数据需要保存到缓冲区当中
      * 然后给channel注册EPOLLOUT事件，Poller发现tcp的发送缓冲区有空间后会通知
      * 相应的sock->channel，调用channel对应注册的writeCallback_回调方法，
      * channel的writeCallback_实际上就是TcpConnection设置的handleWrite回调，
-     * 把发送缓冲区outputBuffer_的内容全部发送完成
+     * 把发送缓冲区outputQueue_的内容全部发送完成
      **/
+    size_t remaining = len - nwrote;
     if (!faultError && remaining > 0)
     {
-        // 目前发送缓冲区剩余的待发送的数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+        checkHighWaterMark(remaining);
+        outputQueue_.append(static_cast<const char *>(data) + nwrote, remaining);
+        scheduleWrite();
+        checkOutputLimit();
+    }
+    noteBufferActivity();
+}
+
+// 与sendInLoop相同 只是没写完的部分以引用的方式进入输出队列 不拷贝数据
+void TcpConnection::sendPayloadInLoop(const PayloadPtr &payload)
+{
+    size_t nwrote = 0;
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    if (canWriteDirectly())
+    {
+        if (zeroCopyThreshold_ > 0 && payload->size() >= zeroCopyThreshold_)
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+            nwrote = checkDirectWrite(sendZeroCopy(payload, 0, payload->size()), payload->size(), &faultError);
         }
-        outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        else
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件 否则poller不会给channel通知epollout
+            struct iovec vec;
+            vec.iov_base = const_cast<char *>(payload->data());
+            vec.iov_len = payload->size();
+            nwrote = writeDirectly(&vec, 1, payload->size(), &faultError);
         }
     }
+
+    size_t remaining = payload->size() - nwrote;
+    if (!faultError && remaining > 0)
+    {
+        checkHighWaterMark(remaining);
+        outputQueue_.append(payload, nwrote);
+        scheduleWrite();
+        checkOutputLimit();
+    }
+    noteBufferActivity();
 }
 
-void TcpConnection::shutdown()
+bool TcpConnection::canWriteDirectly() const
 {
-    if (state_ == kConnected)
+    // 完成式I/O的写都经过输出队列 保证与进行中的sendmsg的顺序
+    return !autoCork_ && !uring_ && !channel_->isWriting() && outputQueue_.readableBytes() == 0;
+}
+
+size_t TcpConnection::writeDirectly(const struct iovec *iov, int iovcnt, size_t len, bool *faultError)
+{
+    return checkDirectWrite(::writev(channel_->fd(), iov, iovcnt), len, faultError);
+}
+
+size_t TcpConnection::checkDirectWrite(ssize_t nwrote, size_t len, bool *faultError)
+{
+    if (nwrote >= 0)
     {
-        setState(kDisconnecting);
-        loop_->runInLoop(
-            std::bind(&TcpConnection::shutdownInLoop, this));
+        if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_)
+        {
+            // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
+            loop_->queueInLoop(
+                std::bind(writeCompleteCallback_, shared_from_this()));
+        }
+        return nwrote;
     }
+
+    if (errno != EWOULDBLOCK) // EWOULDBLOCK表示非阻塞情况下没有数据后的正常返回 等同于EAGAIN
+    {
+        LOG_ERROR("TcpConnection::sendInLoop");
+        if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE RESET
+        {
+            *faultError = true;
+        }
+    }
+    return 0;
 }
 
-// 在事件循环线程中执行关闭写端操作
-void TcpConnection::shutdownInLoop()
+ssize_t TcpConnection::sendZeroCopy(const PayloadPtr &payload, size_t offset, size_t len)
 {
-    // 只有当所有数据都已发送完毕时才真正关闭写端
-    if (!channel_->isWriting())
+    const char *data = payload->data() + offset;
+    ssize_t n = ::send(channel_->fd(), data, len, MSG_ZEROCOPY);
+    if (n >= 0)
     {
-        socket_->shutdownWrite();
+        // 每次成功的发送都占用一个序号 哪怕只发出了一部分
+        zeroCopyPending_.push_back(ZeroCopyReaper::Pending{zeroCopyNextId_++, payload});
+        ++zeroCopyStats_.sends;
+        zeroCopyStats_.bytes += n;
+        return n;
     }
+    if (errno == ENOBUFS) // 锁定的页超过了optmem限制 这一次退回普通发送
+    {
+        ++zeroCopyStats_.fallbacks;
+        return ::send(channel_->fd(), data, len, 0);
+    }
+    return n;
 }
 
-
-// 连接建立
-void TcpConnection::connectEstablished()
+bool TcpConnection::reapZeroCopyCompletions()
 {
-    setState(kConnected);
-    channel_->tie(shared_from_this()); // 绑定生命周期，防止回调时对象被销毁
-    channel_->enableReading();         // 注册读事件
+    return ZeroCopyReaper::reap(channel_->fd(), &zeroCopyPending_, [this](uint32_t lo, uint32_t hi, bool copied) {
+        zeroCopyStats_.completions += hi - lo + 1;
+        if (copied)
+        {
+            zeroCopyStats_.copied += hi - lo + 1;
+            if (zeroCopyThreshold_ > 0)
+            {
+                LOG_INFO("TcpConnection::reapZeroCopyCompletions [%s] kernel copied, fall back to normal send\n", name_.c_str());
+                zeroCopyThreshold_ = 0; // 内核还是做了拷贝 零拷贝只剩下额外的通知开销
+            }
+        }
+    });
+}
 
-    connectionCallback_(shared_from_this()); // 执行连接建立回调
+bool TcpConnection::relay(const TcpConnectionPtr &a, const TcpConnectionPtr &b)
+{
+    if (a->loop_ != b->loop_ || !a->loop_->isInLoopThread())
+    {
+        LOG_ERROR("TcpConnection::relay [%s] [%s] must belong to the current loop\n", a->name_.c_str(), b->name_.c_str());
+        return false;
+    }
+    if (!a->connected() || !b->connected() || a->relaying() || b->relaying() || a->uring_ || b->uring_)
+    {
+        return false;
+    }
+    PipePool *pool = a->loop_->pipePool();
+    PipePool::Pipe ab = pool->acquire();
+    PipePool::Pipe ba = pool->acquire();
+    if (!ab.valid() || !ba.valid())
+    {
+        pool->release(ab, true);
+        pool->release(ba, true);
+        return false;
+    }
+    a->startRelay(b, ab);
+    b->startRelay(a, ba);
+    return true;
 }
 
-// 连接销毁
-void TcpConnection::connectDestroyed()
+void TcpConnection::startRelay(const TcpConnectionPtr &peer, const PipePool::Pipe &pipe)
 {
-    if (state_ == kConnected)
+    if (edgeTriggered_)
     {
-        setState(kDisconnected);
-        channel_->disableAll(); // 移除所有事件监听
-        connectionCallback_(shared_from_this());
+        setEdgeTriggered(false); // 对接转发每次事件只splice一次 依赖水平触发
     }
-    channel_->remove(); // 从事件循环中移除通道
+    relayPeer_ = peer;
+    relayPipe_ = pipe;
+    relayPipeBytes_ = 0;
+    relayReadEof_ = false;
+    relayWriteShut_ = false;
+    // 已经读到用户态的数据先走输出队列 对方会先发完输出队列再发管道中的数据 顺序不会乱
+    if (inputChain_ && inputChain_->readableBytes() > 0)
+    {
+        peer->send(inputChain_->retrieveAllAsString());
+    }
+    if (inputBuffer_.readableBytes() > 0)
+    {
+        peer->send(&inputBuffer_);
+    }
+    startReadInLoop();
 }
 
-// 读是相对服务器而言的 当对端客户端有数据到达 服务器端检测到EPOLLIN 就会触发该fd上的回调 handleRead取读走对端发来的数据
-void TcpConnection::handleRead(Timestamp receiveTime)
+void TcpConnection::handleRelayRead()
 {
-    int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-    if (n > 0) // 有数据到达
+    TcpConnectionPtr peer = relayPeer_.lock();
+    if (!peer)
     {
-        // 已建立连接的用户有可读事件发生了 调用用户传入的回调操作onMessage shared_from_this就是获取了TcpConnection的智能指针
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        forceCloseInLoop();
+        return;
     }
-    else if (n == 0) // 客户端断开
+    size_t space = relayPipe_.capacity - relayPipeBytes_;
+    if (space == 0)
     {
-        handleClose();
+        stopReadInLoop(); // 管道满了 等对方取走数据后再读
+        return;
     }
-    else // 出错了
+    ssize_t n = ::splice(channel_->fd(), nullptr, relayPipe_.writeFd, nullptr, space, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0)
     {
-        errno = savedErrno;
-        LOG_ERROR("TcpConnection::handleRead");
-        handleError();
+        relayPipeBytes_ += n;
+        if (relayPipeBytes_ >= relayPipe_.capacity)
+        {
+            stopReadInLoop();
+        }
+        peer->relayFlush();
+    }
+    else if (n == 0) // 对端发来FIN 本方向转发完剩余数据后关闭对方的写端
+    {
+        relayReadEof_ = true;
+        stopReadInLoop();
+        peer->relayFlush();
+    }
+    else if (errno != EAGAIN)
+    {
+        LOG_ERROR("TcpConnection::handleRelayRead [%s] splice error:%d\n", name_.c_str(), errno);
+        forceCloseInLoop();
     }
 }
 
-void TcpConnection::handleWrite()
+void TcpConnection::relayFlush()
 {
-    if (channel_->isWriting())
+    TcpConnectionPtr src = relayPeer_.lock();
+    if (!src || !src->relayPipe_.valid() || state_ == kDisconnected)
     {
-        int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        return;
+    }
+    if (outputQueue_.readableBytes() > 0)
+    {
+        return; // 输出队列里的数据还没发完 handleWrite发完后会再调用
+    }
+    while (src->relayPipeBytes_ > 0)
+    {
+        ssize_t n = ::splice(src->relayPipe_.readFd, nullptr, channel_->fd(), nullptr, src->relayPipeBytes_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);//从缓冲区读取reable区域的数据移动readindex下标
-            if (outputBuffer_.readableBytes() == 0)
+            src->relayPipeBytes_ -= n;
+        }
+        else if (n < 0 && errno == EAGAIN)
+        {
+            if (!channel_->isWriting())
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // TcpConnection对象在其所在的subloop中 向pendingFunctors_中加入回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop(); // 在当前所属的loop中把TcpConnection删除掉
-                }
+                channel_->enableWriting(); // socket发送缓冲区满了 等EPOLLOUT
             }
+            return;
         }
         else
         {
-            LOG_ERROR("TcpConnection::handleWrite");
+            LOG_ERROR("TcpConnection::relayFlush [%s] splice error:%d\n", name_.c_str(), errno);
+            forceCloseInLoop();
+            return;
         }
     }
-    else
+
+    // 管道已经取空
+    if (channel_->isWriting())
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing", channel_->fd());
+        channel_->disableWriting();
+    }
+    if (!src->relayReadEof_)
+    {
+        src->startReadInLoop(); // 解除背压
+    }
+    else if (!relayWriteShut_)
+    {
+        relayWriteShut_ = true;
+        socket_->shutdownWrite();
+        if (src->relayWriteShut_) // 两个方向都结束了
+        {
+            forceClose();
+            src->forceClose();
+        }
     }
 }
 
-void TcpConnection::handleClose()
+void TcpConnection::stopRelay()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d\n", channel_->fd(), (int)state_);
-    setState(kDisconnected);
-    channel_->disableAll();
+    if (relayPipe_.valid())
+    {
+        loop_->pipePool()->release(relayPipe_, relayPipeBytes_ == 0);
+        relayPipe_ = PipePool::Pipe();
+        relayPipeBytes_ = 0;
+    }
+    relayPeer_.reset();
+}
 
-    TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // 连接回调
-    closeCallback_(connPtr);      // 执行关闭连接的回调 执行的是TcpServer::removeConnection回调方法   // must be the last line
+void TcpConnection::checkHighWaterMark(size_t adding)
+{
+    // 目前发送缓冲区剩余的待发送的数据的长度
+    size_t oldLen = outputQueue_.readableBytes();
+    if (oldLen + adding >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+    {
+        loop_->queueInLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + adding));
+    }
 }
 
-void TcpConnection::handleError()
+// 待发送数据超过上限时只回调一次 降回上限以下后才会再次回调
+void TcpConnection::checkOutputLimit()
 {
-    int optval;
-    socklen_t optlen = sizeof optval;
-    int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    size_t bytes = outputQueue_.readableBytes();
+    if (bufferPolicy_.maxOutputSize == 0 || bytes <= bufferPolicy_.maxOutputSize || outputOverflowed_)
     {
-        err = errno;
+        return;
     }
-    else
+    outputOverflowed_ = true;
+    if (bufferOverflowCallback_)
     {
-        err = optval;
+        loop_->queueInLoop(
+            std::bind(bufferOverflowCallback_, shared_from_this(), bytes));
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection::checkOutputLimit [%s] pending %zu bytes exceeds limit, force close\n", name_.c_str(), bytes);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+// 输入超限时暂停读取 交给上层处理 不设置回调时直接断开
+void TcpConnection::checkInputLimit()
+{
+    size_t bytes = inputBytes();
+    if (bufferPolicy_.maxInputSize == 0 || bytes <= bufferPolicy_.maxInputSize)
+    {
+        return;
+    }
+    if (bufferOverflowCallback_)
+    {
+        stopReadInLoop();
+        inputOverflowed_ = true; // 每轮loop末尾检查 上层把数据取走后恢复读取
+        bufferOverflowCallback_(shared_from_this(), bytes);
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection::checkInputLimit [%s] input %zu bytes exceeds limit, force close\n", name_.c_str(), bytes);
+        forceCloseInLoop();
+    }
+}
+
+size_t TcpConnection::inputBytes() const
+{
+    return inputChain_ ? inputChain_->readableBytes() : inputBuffer_.readableBytes();
+}
+
+// 缓冲区是否比现有数据加基线大小更大 即还有可以收缩的空间
+static bool oversized(size_t capacity, size_t readable, size_t baseline)
+{
+    return capacity > Buffer::kCheapPrepend + readable + baseline;
+}
+
+bool TcpConnection::needsIterationCheck() const
+{
+    if (inputOverflowed_)
+    {
+        return true;
+    }
+    if (bufferPolicy_.shrinkAfterIdleIterations <= 0)
+    {
+        return false;
+    }
+    // 借用BufferPool存储的输入缓冲区由pool负责回收 不在这里收缩
+    bool inputOversized = !bufferPool_ && !inputChain_ &&
+                          oversized(inputBuffer_.internalCapacity(), inputBuffer_.readableBytes(), bufferPolicy_.initialInputSize);
+    bool outputOversized = !bufferPool_ &&
+                           oversized(outputQueue_.bufferCapacity(), outputQueue_.readableBytes(), bufferPolicy_.initialOutputSize);
+    return inputOversized || outputOversized;
+}
+
+void TcpConnection::noteBufferActivity()
+{
+    lastActiveIteration_ = loop_->iteration();
+    if (iterationCheckRegistered_ || !needsIterationCheck())
+    {
+        return;
+    }
+    iterationCheckRegistered_ = true;
+    // 只持有弱引用 连接销毁后检查函数在下一轮返回false被移除
+    std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+    loop_->addIterationCheck([weakConn]() {
+        TcpConnectionPtr conn = weakConn.lock();
+        return conn && conn->checkBufferIdle();
+    });
+}
+
+bool TcpConnection::checkBufferIdle()
+{
+    if (state_ == kDisconnected)
+    {
+        iterationCheckRegistered_ = false;
+        return false;
+    }
+    if (inputOverflowed_ && inputBytes() <= bufferPolicy_.maxInputSize)
+    {
+        inputOverflowed_ = false;
+        startReadInLoop();
+    }
+    int idle = bufferPolicy_.shrinkAfterIdleIterations;
+    if (idle > 0 && loop_->iteration() - lastActiveIteration_ >= static_cast<uint64_t>(idle) && !bufferPool_)
+    {
+        if (!inputChain_ &&
+            oversized(inputBuffer_.internalCapacity(), inputBuffer_.readableBytes(), bufferPolicy_.initialInputSize))
+        {
+            inputBuffer_.shrink(bufferPolicy_.initialInputSize);
+        }
+        if (oversized(outputQueue_.bufferCapacity(), outputQueue_.readableBytes(), bufferPolicy_.initialOutputSize))
+        {
+            outputQueue_.shrinkBuffer(bufferPolicy_.initialOutputSize);
+        }
+    }
+    iterationCheckRegistered_ = needsIterationCheck();
+    return iterationCheckRegistered_;
+}
+
+void TcpConnection::shutdown()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnecting);
+        loop_->runInLoop(
+            std::bind(&TcpConnection::shutdownInLoop, this));
+    }
+}
+
+// 在事件循环线程中执行关闭写端操作
+void TcpConnection::shutdownInLoop()
+{
+    // 只有当所有数据都已发送完毕时才真正关闭写端 自动合并写时数据可能还在输出队列里等本轮末尾写出
+    if (!channel_->isWriting() && outputQueue_.readableBytes() == 0)
+    {
+        socket_->shutdownWrite();
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose(); // 直接按对端关闭处理 丢弃输出队列中未发送的数据
+    }
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    if (!reading_ || !channel_->isReading())
+    {
+        channel_->enableReading();
+        reading_ = true;
+    }
+    if (inputUndelivered_ && state_ == kConnected)
+    {
+        // 取消recv之前内核已经放进来的数据
+        inputUndelivered_ = false;
+        deliverInput(Timestamp::now());
+    }
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    if (reading_ || channel_->isReading())
+    {
+        channel_->disableReading();
+        reading_ = false;
+    }
+}
+
+// 连接建立
+void TcpConnection::connectEstablished()
+{
+    setState(kConnected);
+    channel_->tie(shared_from_this()); // 绑定生命周期，防止回调时对象被销毁
+    if (useIoUring_)
+    {
+        enterCompletionMode();
+    }
+    channel_->enableReading();         // 注册读事件 完成式I/O时挂上multishot recv
+
+    connectionCallback_(shared_from_this()); // 执行连接建立回调
+}
+
+// 连接销毁
+void TcpConnection::connectDestroyed()
+{
+    if (state_ == kConnected)
+    {
+        setState(kDisconnected);
+        channel_->disableAll(); // 移除所有事件监听
+        connectionCallback_(shared_from_this());
+    }
+    // TcpServer析构时连接可能还在kDisconnecting 之后到达的完成项看到kDisconnected只做清理
+    setState(kDisconnected);
+    channel_->remove(); // 从事件循环中移除通道
+    if (recvRequest_ != 0)
+    {
+        // 完成模式下remove不会取消recv 没经过disableAll时multishot recv还挂着并持有连接，
+        // 之后的完成项会调用closeCallback_ 而TcpServer可能已经不在了 丢弃它的完成项
+        uring_->cancel(recvRequest_, true);
+        recvRequest_ = 0;
+    }
+
+    // 内存块和存储属于本loop的BlockPool/BufferPool 必须在loop线程中归还 不能等到TcpConnection在其它线程析构时
+    if (inputChain_)
+    {
+        inputChain_->releaseAll();
+    }
+    if (bufferPool_)
+    {
+        inputBuffer_.retrieveAll();
+        bufferPool_->release(&inputBuffer_);
+    }
+    if (sendRequest_ != 0)
+    {
+        // 内核还在引用输出队列的内存 等sendmsg结束时在handleSendCompletion中归还
+        uring_->cancel(sendRequest_);
+    }
+    else
+    {
+        outputQueue_.releaseAll();
+    }
+    if (!zeroCopyPending_.empty())
+    {
+        // skb还直接引用着这些Payload的内存 交给本loop等完成通知到齐后再释放
+        loop_->zeroCopyReaper()->adopt(channel_->fd(), std::move(zeroCopyPending_));
+        zeroCopyPending_.clear();
+    }
+    stopRelay();
+}
+
+// 读是相对服务器而言的 当对端客户端有数据到达 服务器端检测到EPOLLIN 就会触发该fd上的回调 handleRead取读走对端发来的数据
+ssize_t TcpConnection::readOnce(int *savedErrno)
+{
+    if (inputChain_)
+    {
+        return inputChain_->readFd(channel_->fd(), savedErrno);
+    }
+    else if (adaptiveRead_)
+    {
+        return inputBuffer_.readFd(channel_->fd(), savedErrno, &readSizer_, loop_->recvSpill(), loop_->recvSpillSize(),
+                                   bufferPool_ != nullptr);
+    }
+    return inputBuffer_.readFd(channel_->fd(), savedErrno);
+}
+
+void TcpConnection::handleRead(Timestamp receiveTime)
+{
+    if (relayPipe_.valid())
+    {
+        handleRelayRead();
+        return;
+    }
+    edgeReadPending_ = false;
+    int savedErrno = 0;
+    if (bufferPool_ && !inputChain_)
+    {
+        bufferPool_->acquire(&inputBuffer_); // 先借好存储 让readv直接读进来
+    }
+    // 水平触发只读一次 边沿触发读到EAGAIN/FIN/出错或预算用完为止
+    ssize_t total = 0;
+    ssize_t n = 0;
+    while ((n = readOnce(&savedErrno)) > 0)
+    {
+        total += n;
+        if (!edgeTriggered_ || static_cast<size_t>(total) >= edgeBudget_)
+        {
+            break;
+        }
+    }
+    if (total > 0) // 有数据到达
+    {
+        deliverInput(receiveTime);
+        if (state_ == kDisconnected)
+        {
+            return;
+        }
+    }
+    if (n == 0) // 客户端断开
+    {
+        handleClose();
+    }
+    else if (n < 0)
+    {
+        if (edgeTriggered_ && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))
+        {
+            return; // 已经读空 等下一个边沿
+        }
+        errno = savedErrno; // 出错了
+        LOG_ERROR("TcpConnection::handleRead");
+        handleError();
+    }
+    else if (edgeTriggered_)
+    {
+        scheduleEdgeRead(); // 预算用完 socket上可能还有数据 不会再有新的边沿通知
+    }
+}
+
+void TcpConnection::deliverInput(Timestamp receiveTime)
+{
+    // 已建立连接的用户有可读事件发生了 调用用户传入的回调操作onMessage shared_from_this就是获取了TcpConnection的智能指针
+    if (inputChain_)
+    {
+        chainMessageCallback_(shared_from_this(), inputChain_.get(), receiveTime);
+    }
+    else
+    {
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        if (bufferPool_)
+        {
+            bufferPool_->release(&inputBuffer_); // 数据已被上层取完时归还存储 还有残留的半包则继续持有
+        }
+    }
+    checkInputLimit();
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    noteBufferActivity();
+}
+
+void TcpConnection::scheduleEdgeRead()
+{
+    if (!edgeReadPending_ && reading_)
+    {
+        edgeReadPending_ = true;
+        loop_->queueInLoop(std::bind(&TcpConnection::continueEdgeRead, shared_from_this()));
+    }
+}
+
+void TcpConnection::scheduleEdgeWrite()
+{
+    if (!edgeWritePending_)
+    {
+        edgeWritePending_ = true;
+        loop_->queueInLoop(std::bind(&TcpConnection::continueEdgeWrite, shared_from_this()));
+    }
+}
+
+// 期间如果已经由epoll事件处理过 pending标记已被清掉 什么都不做
+void TcpConnection::continueEdgeRead()
+{
+    if (edgeReadPending_ && reading_ && state_ != kDisconnected && channel_->isReading())
+    {
+        handleRead(Timestamp::now()); // handleRead开头清掉pending标记 预算再次用完时可以重新登记
+    }
+    else
+    {
+        edgeReadPending_ = false;
+    }
+}
+
+void TcpConnection::continueEdgeWrite()
+{
+    if (edgeWritePending_ && state_ != kDisconnected && channel_->isWriting())
+    {
+        handleWrite();
+    }
+    else
+    {
+        edgeWritePending_ = false;
+    }
+}
+
+void TcpConnection::setEdgeTriggered(bool on, size_t budget)
+{
+    edgeTriggered_ = on;
+    edgeBudget_ = budget > 0 ? budget : kDefaultEdgeBudget;
+    channel_->setEdgeTriggered(on);
+}
+
+void TcpConnection::handleWrite()
+{
+    if (relayPeer_.lock() && outputQueue_.readableBytes() == 0)
+    {
+        relayFlush(); // 输出队列已经发完 接着发对方管道中的数据
+        return;
+    }
+    if (channel_->isWriting())
+    {
+        edgeWritePending_ = false;
+        size_t total = 0;
+        // 水平触发只写一次 边沿触发写到EAGAIN、写完或预算用完为止
+        while (true)
+        {
+            int savedErrno = 0;
+            ssize_t n = writeQueued(&savedErrno);
+            if (n > 0 || (n == 0 && outputQueue_.readableBytes() == 0)) // 后者是文件比预期短 剩余部分被丢弃的情况
+            {
+                outputQueue_.retrieve(n);//按写出的字节数依次消费输出队列中的各段
+                if (outputQueue_.readableBytes() <= bufferPolicy_.maxOutputSize)
+                {
+                    outputOverflowed_ = false;
+                }
+                noteBufferActivity();
+                if (outputQueue_.readableBytes() == 0)
+                {
+                    handleQueueDrained();
+                    break;
+                }
+                total += n;
+                if (!edgeTriggered_)
+                {
+                    break;
+                }
+                if (total >= edgeBudget_)
+                {
+                    scheduleEdgeWrite();
+                    break;
+                }
+            }
+            else
+            {
+                if (!edgeTriggered_ || (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK))
+                {
+                    LOG_ERROR("TcpConnection::handleWrite");
+                }
+                break;
+            }
+        }
+    }
+    else
+    {
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing", channel_->fd());
+    }
+}
+
+ssize_t TcpConnection::writeQueued(int *savedErrno)
+{
+    size_t offset = 0;
+    size_t length = 0;
+    PayloadPtr front = zeroCopyThreshold_ > 0 ? outputQueue_.frontPayload(&offset, &length) : PayloadPtr();
+    if (front && length >= zeroCopyThreshold_)
+    {
+        ssize_t n = sendZeroCopy(front, offset, length);
+        if (n < 0)
+        {
+            *savedErrno = errno;
+        }
+        return n;
+    }
+    return outputQueue_.writeFd(channel_->fd(), savedErrno);
+}
+
+void TcpConnection::handleQueueDrained()
+{
+    if (channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+    if (writeCompleteCallback_)
+    {
+        // TcpConnection对象在其所在的subloop中 向pendingFunctors_中加入回调
+        loop_->queueInLoop(
+            std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == kDisconnecting)
+    {
+        shutdownInLoop(); // 在当前所属的loop中把TcpConnection删除掉
+    }
+    if (relayPeer_.lock())
+    {
+        relayFlush();
+    }
+}
+
+void TcpConnection::scheduleWrite()
+{
+    if (channel_->isWriting())
+    {
+        return;
+    }
+    if (!autoCork_ || uring_) // 完成式I/O本来就把本轮的数据合并到一次提交中
+    {
+        channel_->enableWriting(); // 这里一定要注册channel的写事件 否则poller不会给channel通知epollout
+        return;
+    }
+    if (!corkFlushPending_)
+    {
+        // 本轮循环里后续的send都只追加到输出队列 在doPendingFunctors之后统一写一次
+        corkFlushPending_ = true;
+        std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+        loop_->addIterationCheck([weakConn]() {
+            if (TcpConnectionPtr conn = weakConn.lock())
+            {
+                conn->flushCorked();
+            }
+            return false;
+        });
+    }
+}
+
+void TcpConnection::flushCorked()
+{
+    corkFlushPending_ = false;
+    if (state_ == kDisconnected || channel_->isWriting() || outputQueue_.readableBytes() == 0)
+    {
+        return;
+    }
+    if (tcpCork_)
+    {
+        socket_->setTcpCork(true); // 文件段和内存段要分几次写出时 凑满MSS再发
+    }
+    int savedErrno = 0;
+    bool faultError = false;
+    while (outputQueue_.readableBytes() > 0)
+    {
+        ssize_t n = writeQueued(&savedErrno);
+        if (n <= 0)
+        {
+            if (n < 0 && savedErrno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::flushCorked");
+                faultError = savedErrno == EPIPE || savedErrno == ECONNRESET;
+            }
+            break;
+        }
+        outputQueue_.retrieve(n);
+    }
+    if (tcpCork_)
+    {
+        socket_->setTcpCork(false);
+    }
+    if (outputQueue_.readableBytes() <= bufferPolicy_.maxOutputSize)
+    {
+        outputOverflowed_ = false;
+    }
+    if (faultError)
+    {
+        return;
+    }
+    if (outputQueue_.readableBytes() > 0)
+    {
+        channel_->enableWriting(); // socket写满了 剩下的等EPOLLOUT
+    }
+    else
+    {
+        handleQueueDrained();
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name_.c_str(), err);
+}
+
+void TcpConnection::handleClose()
+{
+    LOG_INFO("TcpConnection::handleClose fd=%d state=%d\n", channel_->fd(), (int)state_);
+    setState(kDisconnected);
+    channel_->disableAll();
+
+    if (TcpConnectionPtr peer = relayPeer_.lock())
+    {
+        peer->forceClose(); // 对接的连接一起关闭
+    }
+
+    TcpConnectionPtr connPtr(shared_from_this());
+    connectionCallback_(connPtr); // 连接回调
+    closeCallback_(connPtr);      // 执行关闭连接的回调 执行的是TcpServer::removeConnection回调方法   // must be the last line
+}
+
+void TcpConnection::handleError()
+{
+    // 错误队列里的零拷贝完成通知同样以EPOLLERR的形式报告 取完后不算真正的错误
+    if (!zeroCopyPending_.empty() && reapZeroCopyCompletions())
+    {
+        return;
+    }
+
+    int optval;
+    socklen_t optlen = sizeof optval;
+    int err = 0;
+    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        err = errno;
+    }
+    else
+    {
+        err = optval;
+    }
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name_.c_str(), err);
+}
+
+void TcpConnection::enterCompletionMode()
+{
+    uring_ = loop_->ioUring();
+    if (!uring_)
+    {
+        LOG_ERROR("TcpConnection::enterCompletionMode [%s] io_uring unavailable, keep using the poller\n", name_.c_str());
+        return;
+    }
+    // 队列里的数据在sendmsg完成之前不能移动 ChainBuffer追加时只在尾部加块 已有的数据不动
+    outputQueue_.useChainBuffer(loop_->blockPool());
+    uringSend_.reset(new UringSendState());
+    if (edgeTriggered_)
+    {
+        edgeTriggered_ = false;
+        channel_->setEdgeTriggered(false);
+    }
+    channel_->setUpdateCallback(std::bind(&TcpConnection::onInterestChanged, this));
+}
+
+void TcpConnection::onInterestChanged()
+{
+    if (channel_->isReading())
+    {
+        if (recvRequest_ == 0 && state_ != kDisconnected)
+        {
+            armRecv();
+        }
+    }
+    else if (recvRequest_ != 0)
+    {
+        uring_->cancel(recvRequest_); // 最后一个完成项到达前收到的数据照常放进输入缓冲区
+    }
+
+    if (channel_->isWriting())
+    {
+        if (sendRequest_ == 0 && !sendPrepPending_)
+        {
+            // 等到本轮提交前再组sendmsg 本轮之后的send都合并进来
+            sendPrepPending_ = true;
+            uring_->runBeforeSubmit(std::bind(&TcpConnection::prepareSend, shared_from_this()));
+        }
+    }
+    else if (sendRequest_ != 0)
+    {
+        uring_->cancel(sendRequest_); // 连接关闭 对端不读时sendmsg不会自己结束
+    }
+}
+
+void TcpConnection::armRecv()
+{
+    // 请求持有连接的引用 连接在最后一个完成项到达前不会析构
+    recvRequest_ = uring_->recvMultishot(channel_->fd(),
+        std::bind(&TcpConnection::handleRecvCompletion, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+}
+
+void TcpConnection::handleRecvCompletion(int res, uint32_t flags)
+{
+    bool more = flags & IORING_CQE_F_MORE;
+    if (!more)
+    {
+        recvRequest_ = 0;
+    }
+    if (res > 0)
+    {
+        uint16_t bid = IoUringEngine::bufferId(flags);
+        const char *data = uring_->bufferData(bid);
+        if (inputChain_)
+        {
+            inputChain_->append(data, res);
+        }
+        else
+        {
+            if (bufferPool_)
+            {
+                bufferPool_->acquire(&inputBuffer_);
+            }
+            inputBuffer_.append(data, res);
+        }
+        uring_->recycleBuffer(bid);
+        if (state_ == kDisconnected)
+        {
+            return;
+        }
+        if (!reading_)
+        {
+            inputUndelivered_ = true;
+        }
+        else
+        {
+            deliverInput(Timestamp::now());
+            if (state_ == kDisconnected)
+            {
+                return;
+            }
+        }
+    }
+    else if (res == 0) // 客户端断开
+    {
+        if (state_ != kDisconnected)
+        {
+            handleClose();
+        }
+        return;
+    }
+    else if (res != -ECANCELED && res != -ENOBUFS) // ENOBUFS是接收缓冲区暂时用光 重新挂上即可
+    {
+        if (state_ != kDisconnected)
+        {
+            errno = -res;
+            LOG_ERROR("TcpConnection::handleRecvCompletion");
+            handleError();
+            handleClose();
+        }
+        return;
+    }
+    if (!more && state_ != kDisconnected && channel_->isReading())
+    {
+        armRecv();
+    }
+}
+
+void TcpConnection::prepareSend()
+{
+    sendPrepPending_ = false;
+    while (state_ != kDisconnected && sendRequest_ == 0 && channel_->isWriting() && outputQueue_.readableBytes() > 0)
+    {
+        int iovcnt = outputQueue_.fillIovecs(uringSend_->iov, OutputQueue::kMaxIovecs);
+        if (iovcnt > 0)
+        {
+            ::memset(&uringSend_->msg, 0, sizeof uringSend_->msg);
+            uringSend_->msg.msg_iov = uringSend_->iov;
+            uringSend_->msg.msg_iovlen = iovcnt;
+            sendRequest_ = uring_->sendmsg(channel_->fd(), &uringSend_->msg,
+                std::bind(&TcpConnection::handleSendCompletion, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+            return;
+        }
+        // 队首是文件段 直接sendfile 写不动时等可写再继续
+        int savedErrno = 0;
+        ssize_t n = outputQueue_.writeFd(channel_->fd(), &savedErrno);
+        if (n < 0)
+        {
+            if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+            {
+                sendRequest_ = uring_->pollAdd(channel_->fd(), POLLOUT,
+                    std::bind(&TcpConnection::handleSendReady, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+            }
+            else
+            {
+                LOG_ERROR("TcpConnection::prepareSend"); // 对端已经断开 由recv的完成项关闭连接
+            }
+            return;
+        }
+        outputQueue_.retrieve(n);
+        noteBufferActivity();
+        if (outputQueue_.readableBytes() == 0)
+        {
+            handleQueueDrained();
+        }
+    }
+}
+
+void TcpConnection::handleSendCompletion(int res, uint32_t /*flags*/)
+{
+    sendRequest_ = 0;
+    if (state_ == kDisconnected)
+    {
+        outputQueue_.releaseAll(); // 内核已经不再引用队列的内存
+        return;
+    }
+    if (res == -EAGAIN)
+    {
+        // socket是非阻塞的 部分内核上sendmsg会直接返回EAGAIN而不是等待可写
+        sendRequest_ = uring_->pollAdd(channel_->fd(), POLLOUT,
+            std::bind(&TcpConnection::handleSendReady, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+        return;
+    }
+    if (res < 0)
+    {
+        if (res != -ECANCELED)
+        {
+            errno = -res;
+            LOG_ERROR("TcpConnection::handleSendCompletion"); // 对端已经断开 由recv的完成项关闭连接
+        }
+        return;
+    }
+    outputQueue_.retrieve(res);
+    if (outputQueue_.readableBytes() <= bufferPolicy_.maxOutputSize)
+    {
+        outputOverflowed_ = false;
+    }
+    noteBufferActivity();
+    if (outputQueue_.readableBytes() == 0)
+    {
+        handleQueueDrained();
+    }
+    else
+    {
+        prepareSend(); // 在完成项的回调中 本轮末尾随其它提交项一起提交
+    }
+}
+
+void TcpConnection::handleSendReady(int res, uint32_t /*flags*/)
+{
+    sendRequest_ = 0;
+    if (state_ == kDisconnected)
+    {
+        outputQueue_.releaseAll();
+        return;
+    }
+    if (res < 0 && res != -ECANCELED)
+    {
+        errno = -res;
+        LOG_ERROR("TcpConnection::handleSendReady");
+        return;
+    }
+    prepareSend();
+}
+
+void TcpConnection::setChainMessageCallback(const ChainMessageCallback &cb)
+{
+    chainMessageCallback_ = cb;
+    if (!inputChain_)
+    {
+        inputChain_.reset(new ChainBuffer(loop_->blockPool()));
+    }
+}
+
+void TcpConnection::setBufferPool(BufferPool *pool)
+{
+    bufferPool_ = pool;
+    // 丢掉构造时分配的初始存储 之后只在有数据收发时才从pool借用
+    std::vector<char> input;
+    inputBuffer_.swapStorage(input);
+    outputQueue_.setBufferPool(pool);
+}
+
+void TcpConnection::setBufferPolicy(const BufferPolicy &policy)
+{
+    bufferPolicy_ = policy;
+    inputBuffer_ = Buffer(policy.initialInputSize);
+    inputBuffer_.setGrowthFactor(policy.growthFactor);
+    outputQueue_.initBuffer(policy.initialOutputSize, policy.growthFactor);
+}
+
+bool TcpConnection::setZeroCopy(size_t threshold)
+{
+    if (!socket_->setZeroCopy(true))
+    {
+        LOG_ERROR("TcpConnection::setZeroCopy [%s] SO_ZEROCOPY not supported\n", name_.c_str());
+        return false;
+    }
+    zeroCopyThreshold_ = threshold;
+    return true;
+}
+
+void TcpConnection::setOutputChainBuffer()
+{
+    outputQueue_.useChainBuffer(loop_->blockPool());
 }
 
 // 新增的零拷贝发送函数
 void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count) {
     if (connected()) {
         if (loop_->isInLoopThread()) { // 判断当前线程是否是loop循环的线程
-            sendFileInLoop(fileDescriptor, offset, count);
+            sendFileInLoop(fileDescriptor, offset, count, std::shared_ptr<const void>());
         }else{ // 如果不是，则唤醒运行这个TcpConnection的线程执行Loop循环
             loop_->runInLoop(
-                std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count));
+                std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count, std::shared_ptr<const void>()));
         }
     } else {
         LOG_ERROR("TcpConnection::sendFile - not connected");
@@ -284,18 +1474,87 @@ void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count) {
 }
 
 // 在事件循环中执行sendfile
-void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t count) {
+void TcpConnection::sendFile(const CachedFilePtr &file, const std::string &header)
+{
+    if (connected()) {
+        if (loop_->isInLoopThread()) {
+            sendCachedFileInLoop(file, header);
+        } else {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendCachedFileInLoop, shared_from_this(), file, header));
+        }
+    } else {
+        LOG_ERROR("TcpConnection::sendFile - not connected");
+    }
+}
+
+void TcpConnection::sendCachedFileInLoop(const CachedFilePtr &file, const std::string &header)
+{
+    if (file->mapped())
+    {
+        // 映射的内存由CachedFile持有 Payload引用它而不拷贝
+        sendHeadAndPayloadInLoop(header, Payload::wrap(file->data(), file->size(), file));
+        return;
+    }
+    if (!header.empty())
+    {
+        sendInLoop(header.data(), header.size());
+    }
+    sendFileInLoop(file->fd(), 0, file->size(), file);
+}
+
+void TcpConnection::sendHeadAndPayloadInLoop(const std::string &head, const PayloadPtr &payload)
+{
+    size_t nwrote = 0;
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+
+    size_t total = head.size() + payload->size();
+    if (canWriteDirectly())
+    {
+        struct iovec vec[2];
+        vec[0].iov_base = const_cast<char *>(head.data());
+        vec[0].iov_len = head.size();
+        vec[1].iov_base = const_cast<char *>(payload->data());
+        vec[1].iov_len = payload->size();
+        nwrote = writeDirectly(vec, 2, total, &faultError);
+    }
+
+    if (!faultError && nwrote < total)
+    {
+        checkHighWaterMark(total - nwrote);
+        if (nwrote < head.size())
+        {
+            outputQueue_.append(head.data() + nwrote, head.size() - nwrote);
+            outputQueue_.append(payload, 0);
+        }
+        else
+        {
+            outputQueue_.append(payload, nwrote - head.size());
+        }
+        scheduleWrite();
+        checkOutputLimit();
+    }
+    noteBufferActivity();
+}
+
+void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t count, const std::shared_ptr<const void> &owner) {
     ssize_t bytesSent = 0; // 发送了多少字节数
     size_t remaining = count; // 还要多少数据要发送
     bool faultError = false; // 错误的标志位
 
-    if (state_ == kDisconnecting) { // 表示此时连接已经断开就不需要发送数据了
+    if (state_ == kDisconnected) { // 表示此时连接已经断开就不需要发送数据了
         LOG_ERROR("disconnected, give up writing");
         return;
     }
 
-    // 表示Channel第一次开始写数据或者outputBuffer缓冲区中没有数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
+    // 表示Channel第一次开始写数据或者输出队列中没有数据
+    if (canWriteDirectly()) {
         bytesSent = sendfile(socket_->fd(), fileDescriptor, &offset, remaining);
         if (bytesSent >= 0) {
             remaining -= bytesSent;
@@ -312,10 +1571,11 @@ void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t coun
             }
         }
     }
-    // 处理剩余数据
+    // 剩余的文件区间作为文件段排进输出队列 与内存数据保持发送顺序 等EPOLLOUT后由handleWrite继续sendfile
     if (!faultError && remaining > 0) {
-        // 继续发送剩余数据
-        loop_->queueInLoop(
-            std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, remaining));
+        checkHighWaterMark(remaining);
+        outputQueue_.appendFile(fileDescriptor, offset, remaining, owner);
+        scheduleWrite();
+        checkOutputLimit();
     }
-}
\ No newline at end of file
+}
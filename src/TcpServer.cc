@@ -1,4 +1,5 @@
 #include <functional>
+#include <future>
 #include <string.h>
 
 #include "TcpServer.h"
@@ -19,12 +20,25 @@ TcpServer::TcpServer(EventLoop *loop,
                      const std::string &nameArg,
                      Option option)
     : loop_(CheckLoopNotNull(loop))
+    , listenAddr_(listenAddr)
     , ipPort_(listenAddr.toIpPort())
     , name_(nameArg)
     , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
     , threadPool_(new EventLoopThreadPool(loop, name_))
     , connectionCallback_()
     , messageCallback_()
+    , outputChainBuffer_(false)
+    , bufferPooling_(false)
+    , adaptiveRead_(false)
+    , useFionread_(false)
+    , hasBufferPolicy_(false)
+    , zeroCopyThreshold_(0)
+    , autoCork_(false)
+    , tcpCork_(false)
+    , edgeTriggered_(false)
+    , edgeBudget_(TcpConnection::kDefaultEdgeBudget)
+    , ioEngine_(kReadinessEngine)
+    , perLoopAcceptors_(false)
     , nextConnId_(1)
     , started_(0)
 {
@@ -43,6 +57,30 @@ TcpServer::~TcpServer()
         conn->getLoop()->runInLoop(
             std::bind(&TcpConnection::connectDestroyed, conn));
     }
+    /**
+     * 各subloop的连接表和Acceptor只能在所属loop线程中访问 交给它去销毁，并且要等销毁完成再返回：
+     * Acceptor的回调引用着this，同一轮poll中已经就绪的accept会在销毁之前执行；
+     * 随后线程池析构时subloop退出，还没执行的销毁任务会在EventLoop析构时才释放，那时Poller和IoUringEngine已经不在了
+     **/
+    std::vector<std::future<void>> stopped;
+    for (std::unique_ptr<LoopAcceptor> &owner : loopAcceptors_)
+    {
+        EventLoop *ioLoop = owner->acceptor->getLoop();
+        auto done = std::make_shared<std::promise<void>>();
+        stopped.push_back(done->get_future());
+        ioLoop->runInLoop([owner = std::move(owner), done]() mutable {
+            for (auto &item : owner->connections)
+            {
+                item.second->connectDestroyed();
+            }
+            owner.reset();
+            done->set_value();
+        });
+    }
+    for (std::future<void> &f : stopped)
+    {
+        f.wait();
+    }
 }
 
 // 设置底层subloop的个数
@@ -52,12 +90,34 @@ void TcpServer::setThreadNum(int numThreads)
     threadPool_->setThreadNum(numThreads_);
 }
 
+void TcpServer::setIoEngine(IoEngine engine)
+{
+    ioEngine_ = engine;
+    acceptor_->setUseIoUring(engine == kIoUringEngine);
+}
+
 // 开启服务器监听
 void TcpServer::start()
 {
     if (started_.fetch_add(1) == 0)    // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_);    // 启动底层的loop线程池
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        if (perLoopAcceptors_ && loops[0] != loop_)
+        {
+            // 构造函数中的acceptor_只绑定不监听 连接全部由各subloop的Acceptor接受
+            for (EventLoop *ioLoop : loops)
+            {
+                LoopAcceptor *owner = new LoopAcceptor();
+                owner->acceptor.reset(new Acceptor(ioLoop, listenAddr_, true));
+                owner->acceptor->setNewConnectionCallback(
+                    std::bind(&TcpServer::establishConnection, this, ioLoop, owner, std::placeholders::_1, std::placeholders::_2));
+                owner->acceptor->setUseIoUring(ioEngine_ == kIoUringEngine);
+                loopAcceptors_.emplace_back(owner);
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, owner->acceptor.get()));
+            }
+            return;
+        }
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
@@ -66,10 +126,13 @@ void TcpServer::start()
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
     // 轮询算法 选择一个subLoop 来管理connfd对应的channel
-    EventLoop *ioLoop = threadPool_->getNextLoop(peerAddr.toIp());
+    establishConnection(threadPool_->getNextLoop(peerAddr.toIp()), nullptr, sockfd, peerAddr);
+}
+
+void TcpServer::establishConnection(EventLoop *ioLoop, LoopAcceptor *owner, int sockfd, const InetAddress &peerAddr)
+{
     char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;  // 这里没有设置为原子类是因为其只在mainloop中执行 不涉及线程安全问题
+    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_.fetch_add(1));
     std::string connName = name_ + buf;
 
     LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
@@ -90,15 +153,70 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
                                             sockfd,
                                             localAddr,
                                             peerAddr));
-    connections_[connName] = conn;
+    if (owner)
+    {
+        owner->connections[connName] = conn;
+    }
+    else
+    {
+        connections_[connName] = conn;
+    }
     // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    if (chainMessageCallback_)
+    {
+        conn->setChainMessageCallback(chainMessageCallback_);
+    }
+    if (hasBufferPolicy_)
+    {
+        conn->setBufferPolicy(bufferPolicy_); // 要在setBufferPool之前 启用pool时初始存储会被丢掉
+    }
+    if (bufferOverflowCallback_)
+    {
+        conn->setBufferOverflowCallback(bufferOverflowCallback_);
+    }
+    if (outputChainBuffer_)
+    {
+        conn->setOutputChainBuffer();
+    }
+    if (bufferPooling_)
+    {
+        conn->setBufferPool(ioLoop->bufferPool());
+    }
+    if (adaptiveRead_)
+    {
+        conn->setAdaptiveRead(useFionread_);
+    }
+    if (zeroCopyThreshold_ > 0)
+    {
+        conn->setZeroCopy(zeroCopyThreshold_);
+    }
+    if (autoCork_)
+    {
+        conn->setAutoCork(true, tcpCork_);
+    }
+    if (edgeTriggered_)
+    {
+        conn->setEdgeTriggered(true, edgeBudget_);
+    }
+    if (ioEngine_ == kIoUringEngine)
+    {
+        conn->setIoUring(true);
+    }
 
     // 设置了如何关闭连接的回调
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    if (owner)
+    {
+        conn->setCloseCallback(
+            std::bind(&TcpServer::removeLoopConnection, owner, std::placeholders::_1));
+    }
+    else
+    {
+        conn->setCloseCallback(
+            std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    }
 
     ioLoop->runInLoop(
         std::bind(&TcpConnection::connectEstablished, conn));
@@ -119,4 +237,13 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
     EventLoop *ioLoop = conn->getLoop();
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
-}
\ No newline at end of file
+}
+
+// 连接在所属的subloop中关闭 直接从该loop的连接表中删除 不经过mainloop
+void TcpServer::removeLoopConnection(LoopAcceptor *owner, const TcpConnectionPtr &conn)
+{
+    LOG_INFO("TcpServer::removeLoopConnection - connection %s\n", conn->name().c_str());
+    owner->connections.erase(conn->name());
+    conn->getLoop()->queueInLoop(
+        std::bind(&TcpConnection::connectDestroyed, conn));
+}
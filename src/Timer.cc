@@ -4,14 +4,44 @@
 
 std::atomic<int64_t> Timer::s_numCreated_;
 
+void Timer::reset(TimerCallback cb, Timestamp when, double interval, double slack)
+{
+    callback_ = std::move(cb);
+    expiration_ = roundUp(when, slack);
+    interval_ = interval;
+    slack_ = slack;
+    repeat_ = interval > 0.0;
+    sequence_ = ++s_numCreated_;
+    heapIndex_ = kNotInHeap;
+    canceled_ = false;
+}
+
+void Timer::release()
+{
+    callback_.reset();
+    sequence_ = 0;
+    heapIndex_ = kNotInHeap;
+}
+
 void Timer::restart(Timestamp now)
 {
     if (repeat_)
     {
-        expiration_ = addTime(now, interval_);  // 如果是周期性定时器，重置定时器为当前时间 + 触发的间隔
+        expiration_ = roundUp(addTime(now, interval_), slack_);  // 如果是周期性定时器，重置定时器为当前时间 + 触发的间隔
     }
     else
     {
         expiration_ = Timestamp::invalid();    // 一次性定时器重置为无效时间
     }
 }
+
+Timestamp Timer::roundUp(Timestamp when, double slack)
+{
+    int64_t slackUs = static_cast<int64_t>(slack * Timestamp::kMicroSecondsPerSecond);
+    if (slackUs <= 1)
+    {
+        return when;
+    }
+    int64_t us = when.microSecondsSinceEpoch();
+    return Timestamp((us + slackUs - 1) / slackUs * slackUs);
+}
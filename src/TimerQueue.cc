@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 
 // 创建一个Linux timerfd
 int createTimerfd()
@@ -42,14 +43,15 @@ struct timespec howMuchTimeFromNow(Timestamp when)
 }
 
 // 读取timerfd，清除定时器到期事件，防止epoll重复触发
-void readTimerfd(int timerfd, Timestamp now)
+void readTimerfd(int timerfd, [[maybe_unused]] Timestamp now) // now只用于调试日志
 {
     uint64_t howmany;
     ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
-    LOG_INFO("TimerQueue::handleRead() %d at %s" , howmany, now.toString());
+    // 每个loop的每次到期都会走到这里 只在调试时输出
+    LOG_DEBUG("TimerQueue::handleRead() %lu at %s\n", static_cast<unsigned long>(howmany), now.toString().c_str());
     if (n != sizeof howmany)
     {
-        LOG_ERROR( "TimerQueue::handleRead() reads %d bytes instead of 8", n);
+        LOG_ERROR("TimerQueue::handleRead() reads %zd bytes instead of 8\n", n);
     }
 }
 
@@ -75,7 +77,6 @@ TimerQueue::TimerQueue(EventLoop* loop)
   : loop_(loop)
   , timerfd_(createTimerfd())
   , timerfdChannel_(loop, timerfd_)
-  , timers_()
   , callingExpiredTimers_(false)
 {
     timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
@@ -88,18 +89,23 @@ TimerQueue::~TimerQueue()
     timerfdChannel_.disableAll();
     timerfdChannel_.remove();
     ::close(timerfd_);
-    for (const Entry& timer : timers_)
+    for (Timer* timer : heap_)
     {
-        delete timer.second;
+        delete timer;
+    }
+    for (Timer* timer : freeTimers_)
+    {
+        delete timer;
     }
 }
 
-// 添加定时器，创建Timer对象，将其投递到事件循环线程中异步插入，返回唯一TimerId
-TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+// 添加定时器，取得Timer对象，将其投递到事件循环线程中异步插入，返回唯一TimerId
+TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval, double slack)
 {
-    Timer* timer = new Timer(std::move(cb), when, interval);
+    Timer* timer = acquireTimer(std::move(cb), when, interval, slack);
+    TimerId timerId(timer, timer->sequence()); // 先取序号 跨线程添加时timer可能在runInLoop返回前就到期被复用了
     loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
-    return TimerId(timer, timer->sequence());
+    return timerId;
 }
 
 // 取消定时器
@@ -108,7 +114,24 @@ void TimerQueue::cancel(TimerId timerId)
     loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
 }
 
-// 
+Timer* TimerQueue::acquireTimer(TimerCallback cb, Timestamp when, double interval, double slack)
+{
+    if (loop_->isInLoopThread() && !freeTimers_.empty())
+    {
+        Timer* timer = freeTimers_.back();
+        freeTimers_.pop_back();
+        timer->reset(std::move(cb), when, interval, slack);
+        return timer;
+    }
+    return new Timer(std::move(cb), when, interval, slack);
+}
+
+void TimerQueue::releaseTimer(Timer* timer)
+{
+    timer->release();
+    freeTimers_.push_back(timer);
+}
+
 void TimerQueue::addTimerInLoop(Timer* timer)
 {
     loop_->assertInLoopThread();
@@ -120,24 +143,28 @@ void TimerQueue::addTimerInLoop(Timer* timer)
     }
 }
 
+/**
+ * Timer对象只会回到空闲链表而不会被释放 所以旧TimerId里的指针总是可以安全地访问
+ * 序列号不匹配说明定时器已经结束(可能已被复用) 直接忽略
+ * 不在堆中但序列号匹配 说明它在正在执行的这一批到期定时器里 打上标记由reset处理
+ **/
 void TimerQueue::cancelInLoop(TimerId timerId)
 {
     loop_->assertInLoopThread();
-    assert(timers_.size() == activeTimers_.size());
-    ActiveTimer timer(timerId.timer_, timerId.sequence_);
-    ActiveTimerSet::iterator it = activeTimers_.find(timer);
-    if (it != activeTimers_.end())
+    Timer* timer = timerId.timer_;
+    if (timer == nullptr || timer->sequence() != timerId.sequence_)
+    {
+        return;
+    }
+    if (timer->heapIndex() != Timer::kNotInHeap)
     {
-        size_t n = timers_.erase(Entry(it->first->expiration(), it->first));
-        assert(n == 1); (void)n;
-        delete it->first; // FIXME: no delete please
-        activeTimers_.erase(it);
+        removeAt(timer->heapIndex());
+        releaseTimer(timer);
     }
     else if (callingExpiredTimers_)
     {
-        cancelingTimers_.insert(timer);
+        timer->setCanceled();
     }
-    assert(timers_.size() == activeTimers_.size());
 }
 
 void TimerQueue::handleRead()
@@ -146,94 +173,138 @@ void TimerQueue::handleRead()
     Timestamp now(Timestamp::now());
     readTimerfd(timerfd_, now);
 
-    std::vector<Entry> expired = getExpired(now);
+    getExpired(now);
 
     callingExpiredTimers_ = true;
-    cancelingTimers_.clear();
-    // safe to callback outside critical section
-    for (const Entry& it : expired)
+    // 回调中新加的定时器只会进入堆 不会改动expired_
+    for (Timer* timer : expired_)
     {
-        it.second->run();
+        if (!timer->canceled())
+        {
+            timer->run();
+        }
     }
     callingExpiredTimers_ = false;
 
-    reset(expired, now);
+    reset(now);
 }
 
-// 查找所有到期的定时器，批量移除主集合，并从活跃集合中移除，返回到期定时器列表
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now)
+// 把所有到期的定时器从堆顶依次取出 放入expired_
+void TimerQueue::getExpired(Timestamp now)
 {
-    assert(timers_.size() == activeTimers_.size());
-    std::vector<Entry> expired;
-    Entry sentry(now, reinterpret_cast<Timer*>(UINTPTR_MAX));
-    TimerList::iterator end = timers_.lower_bound(sentry);
-    assert(end == timers_.end() || now < end->first);
-    std::copy(timers_.begin(), end, back_inserter(expired));
-    timers_.erase(timers_.begin(), end);
-
-    for (const Entry& it : expired)
+    expired_.clear();
+    while (!heap_.empty() && !(now < heap_.front()->expiration()))
     {
-        ActiveTimer timer(it.second, it.second->sequence());
-        size_t n = activeTimers_.erase(timer);
-        assert(n == 1); (void)n;
+        Timer* timer = heap_.front();
+        removeAt(0);
+        expired_.push_back(timer);
     }
-
-    assert(timers_.size() == activeTimers_.size());
-    return expired;
 }
 
-// 对于周期性定时器，重启并重新插入，对于一次性定时器或被取消的，直接释放内存
-void TimerQueue::reset(const std::vector<Entry>& expired, Timestamp now)
+// 对于周期性定时器，重启并重新插入，对于一次性定时器或被取消的，放回空闲链表
+void TimerQueue::reset(Timestamp now)
 {
-    Timestamp nextExpire;
-
-    for (const Entry& it : expired)
+    for (Timer* timer : expired_)
     {
-        ActiveTimer timer(it.second, it.second->sequence());
-        if (it.second->repeat() && cancelingTimers_.find(timer) == cancelingTimers_.end())
+        if (timer->repeat() && !timer->canceled())
         {
-            it.second->restart(now);
-            insert(it.second);
+            timer->restart(now);
+            insert(timer);
         }
         else
         {
-            // FIXME move to a free list
-            delete it.second; // FIXME: no delete please
+            releaseTimer(timer);
         }
     }
+    expired_.clear();
 
-    if (!timers_.empty())
+    if (!heap_.empty())
     {
-        nextExpire = timers_.begin()->second->expiration();
-    }
-
-    if (nextExpire.valid())
-    {
-        resetTimerfd(timerfd_, nextExpire);
+        resetTimerfd(timerfd_, heap_.front()->expiration());
     }
 }
 
 bool TimerQueue::insert(Timer* timer)
 {
     loop_->assertInLoopThread();    // 确保当前代码运行在事件循环线程中，保证线程安全
-    assert(timers_.size() == activeTimers_.size()); 
-    bool earliestChanged = false;   // 标记是否插入了新的最早到期定时器
-    Timestamp when = timer->expiration();   // 获取当前定时器的到期时间
-    TimerList::iterator it = timers_.begin();   // 判断新定时器是不是最早到期的
-    if (it == timers_.end() || when < it->first)
+    heap_.push_back(timer);
+    place(heap_.size() - 1, timer);
+    siftUp(heap_.size() - 1);
+    return heap_.front() == timer;  // 新定时器成为最早到期的才需要重设timerfd
+}
+
+// 到期时间相同的按序列号先后 保证先添加的先执行
+bool TimerQueue::earlier(const Timer* lhs, const Timer* rhs)
+{
+    if (lhs->expiration() == rhs->expiration())
     {
-        earliestChanged = true;
+        return lhs->sequence() < rhs->sequence();
     }
+    return lhs->expiration() < rhs->expiration();
+}
+
+void TimerQueue::place(size_t index, Timer* timer)
+{
+    heap_[index] = timer;
+    timer->setHeapIndex(index);
+}
+
+void TimerQueue::siftUp(size_t index)
+{
+    Timer* timer = heap_[index];
+    while (index > 0)
     {
-        std::pair<TimerList::iterator, bool> result = timers_.insert(Entry(when, timer));
-        assert(result.second); (void)result;
+        size_t parent = (index - 1) / kArity;
+        if (!earlier(timer, heap_[parent]))
+        {
+            break;
+        }
+        place(index, heap_[parent]);
+        index = parent;
     }
+    place(index, timer);
+}
+
+void TimerQueue::siftDown(size_t index)
+{
+    Timer* timer = heap_[index];
+    size_t size = heap_.size();
+    while (true)
     {
-        std::pair<ActiveTimerSet::iterator, bool> result = activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
-        assert(result.second); (void)result;
+        size_t first = index * kArity + 1;
+        if (first >= size)
+        {
+            break;
+        }
+        size_t last = std::min(first + kArity, size);
+        size_t child = first;
+        for (size_t i = first + 1; i < last; ++i)
+        {
+            if (earlier(heap_[i], heap_[child]))
+            {
+                child = i;
+            }
+        }
+        if (!earlier(heap_[child], timer))
+        {
+            break;
+        }
+        place(index, heap_[child]);
+        index = child;
     }
-
-    assert(timers_.size() == activeTimers_.size());
-    return earliestChanged;
+    place(index, timer);
 }
 
+void TimerQueue::removeAt(size_t index)
+{
+    assert(index < heap_.size());
+    heap_[index]->setHeapIndex(Timer::kNotInHeap);
+    Timer* last = heap_.back();
+    heap_.pop_back();
+    if (index < heap_.size())
+    {
+        place(index, last);
+        siftDown(index);
+        siftUp(index);
+    }
+}
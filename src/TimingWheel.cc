@@ -0,0 +1,243 @@
+#include <algorithm>
+
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+TimingWheel::TimingWheel(EventLoop *loop, double tickSeconds)
+    : loop_(loop)
+    , tickUs_(std::max<int64_t>(1, static_cast<int64_t>(tickSeconds * Timestamp::kMicroSecondsPerSecond)))
+    , start_(Timestamp::now())
+    , nextTick_(0)
+    , count_(0)
+    , root_(kRootSize, kNil)
+    , expiring_(kNil)
+    , ticking_(false)
+{
+    for (std::vector<uint32_t> &level : levels_)
+    {
+        level.assign(kLevelSize, kNil);
+    }
+}
+
+TimingWheel::~TimingWheel()
+{
+    if (ticking_)
+    {
+        loop_->cancel(tickTimer_);
+    }
+}
+
+WheelTimerId TimingWheel::schedule(double delay, Callback cb)
+{
+    loop_->assertInLoopThread();
+    startTicking(); // 先同步nextTick_ 再计算到期tick
+
+    uint32_t index;
+    if (!freeList_.empty())
+    {
+        index = freeList_.back();
+        freeList_.pop_back();
+    }
+    else
+    {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+    Node &node = nodes_[index];
+    node.cb = std::move(cb);
+    node.expires = ticksFor(delay);
+    link(index);
+    ++count_;
+    return WheelTimerId(index, node.generation);
+}
+
+bool TimingWheel::restart(WheelTimerId id, double delay)
+{
+    loop_->assertInLoopThread();
+    Node *node = lookup(id);
+    if (node == nullptr)
+    {
+        return false;
+    }
+    unlink(id.index_);
+    node->expires = ticksFor(delay);
+    link(id.index_);
+    return true;
+}
+
+bool TimingWheel::cancel(WheelTimerId id)
+{
+    loop_->assertInLoopThread();
+    if (lookup(id) == nullptr)
+    {
+        return false;
+    }
+    unlink(id.index_);
+    release(id.index_);
+    return true;
+}
+
+// 向上取整 保证不早于delay触发
+uint64_t TimingWheel::ticksFor(double delay) const
+{
+    int64_t dueUs = Timestamp::now().microSecondsSinceEpoch() - start_.microSecondsSinceEpoch()
+                    + static_cast<int64_t>(delay * Timestamp::kMicroSecondsPerSecond);
+    uint64_t expires = dueUs <= 0 ? 0 : static_cast<uint64_t>((dueUs + tickUs_ - 1) / tickUs_);
+    return std::min(std::max(expires, nextTick_), nextTick_ + kMaxTicks);
+}
+
+TimingWheel::Node *TimingWheel::lookup(WheelTimerId id)
+{
+    if (!id.valid() || id.index_ >= nodes_.size())
+    {
+        return nullptr;
+    }
+    Node &node = nodes_[id.index_];
+    if (node.generation != id.generation_ || node.slot == nullptr)
+    {
+        return nullptr;
+    }
+    return &node;
+}
+
+void TimingWheel::link(uint32_t index)
+{
+    Node &node = nodes_[index];
+    uint64_t delta = node.expires - nextTick_;
+    uint32_t *slot;
+    if (delta < kRootSize)
+    {
+        slot = &root_[node.expires & kRootMask];
+    }
+    else
+    {
+        int level = 1;
+        while (level < kLevels - 1 && delta >= (1ull << (kRootBits + level * kLevelBits)))
+        {
+            ++level;
+        }
+        slot = &levels_[level - 1][(node.expires >> (kRootBits + (level - 1) * kLevelBits)) & kLevelMask];
+    }
+
+    node.prev = kNil;
+    node.next = *slot;
+    if (*slot != kNil)
+    {
+        nodes_[*slot].prev = index;
+    }
+    *slot = index;
+    node.slot = slot;
+}
+
+void TimingWheel::unlink(uint32_t index)
+{
+    Node &node = nodes_[index];
+    if (node.prev != kNil)
+    {
+        nodes_[node.prev].next = node.next;
+    }
+    else
+    {
+        *node.slot = node.next;
+    }
+    if (node.next != kNil)
+    {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.prev = kNil;
+    node.next = kNil;
+    node.slot = nullptr;
+}
+
+void TimingWheel::release(uint32_t index)
+{
+    Node &node = nodes_[index];
+    node.cb.reset();
+    if (++node.generation == 0)
+    {
+        node.generation = 1;
+    }
+    freeList_.push_back(index);
+    --count_;
+}
+
+// 把高层的一个槽整体取下 按新的nextTick_重新挂到低层
+void TimingWheel::cascade(int level, uint32_t slot)
+{
+    uint32_t index = levels_[level - 1][slot];
+    levels_[level - 1][slot] = kNil;
+    while (index != kNil)
+    {
+        uint32_t next = nodes_[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+void TimingWheel::startTicking()
+{
+    if (ticking_)
+    {
+        return;
+    }
+    // 空转期间没有推进tick 轮中为空 直接跳到当前时间即可
+    int64_t elapsedUs = Timestamp::now().microSecondsSinceEpoch() - start_.microSecondsSinceEpoch();
+    nextTick_ = std::max(nextTick_, static_cast<uint64_t>(std::max<int64_t>(0, elapsedUs / tickUs_)));
+    ticking_ = true;
+    tickTimer_ = loop_->runEvery(tick(), [this]() { onTick(); });
+}
+
+void TimingWheel::onTick()
+{
+    int64_t elapsedUs = Timestamp::now().microSecondsSinceEpoch() - start_.microSecondsSinceEpoch();
+    uint64_t target = static_cast<uint64_t>(std::max<int64_t>(0, elapsedUs / tickUs_));
+    // loop被阻塞过时一次补上错过的tick
+    while (nextTick_ <= target && count_ > 0)
+    {
+        runTick();
+    }
+    if (count_ == 0)
+    {
+        loop_->cancel(tickTimer_);
+        ticking_ = false;
+    }
+}
+
+void TimingWheel::runTick()
+{
+    uint32_t slot = static_cast<uint32_t>(nextTick_ & kRootMask);
+    if (slot == 0)
+    {
+        for (int level = 1; level < kLevels; ++level)
+        {
+            uint32_t index = static_cast<uint32_t>((nextTick_ >> (kRootBits + (level - 1) * kLevelBits)) & kLevelMask);
+            cascade(level, index);
+            if (index != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    /**
+     * 把到期的链表整条移到expiring_上再逐个执行：
+     * 回调里新加的定时器到期tick至少是nextTick_+1 可能落回同一个槽 不能在这一轮被执行
+     * 回调里取消同一批到期的其它定时器时 unlink通过slot指针正确地从expiring_上摘除
+     **/
+    expiring_ = root_[slot];
+    root_[slot] = kNil;
+    for (uint32_t index = expiring_; index != kNil; index = nodes_[index].next)
+    {
+        nodes_[index].slot = &expiring_;
+    }
+    ++nextTick_;
+
+    while (expiring_ != kNil)
+    {
+        uint32_t index = expiring_;
+        unlink(index);
+        Callback cb = std::move(nodes_[index].cb); // 回调里可能新加定时器复用这个节点
+        release(index);
+        cb();
+    }
+}
@@ -0,0 +1,139 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h> // for sock_extended_err
+
+#include "ZeroCopyReaper.h"
+#include "EventLoop.h"
+#include "Channel.h"
+#include "Logger.h"
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+ZeroCopyReaper::ZeroCopyReaper(EventLoop *loop)
+    : loop_(loop)
+{
+}
+
+ZeroCopyReaper::~ZeroCopyReaper()
+{
+    // loop退出时还没等到的通知不再等 进程里的这块内存也不会再被复用
+    for (auto &item : drains_)
+    {
+        item.second->channel->disableAll();
+        item.second->channel->remove();
+        ::close(item.first);
+    }
+}
+
+bool ZeroCopyReaper::reap(int fd, PendingQueue *pending, const RangeCallback &onRange)
+{
+    bool reaped = false;
+    char control[128];
+    for (;;)
+    {
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
+        {
+            break; // EAGAIN 错误队列已经取空
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                continue;
+            }
+            const struct sock_extended_err *serr = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+            {
+                continue;
+            }
+            // 一条通知确认序号区间[ee_info, ee_data]内的发送全部完成
+            uint32_t lo = serr->ee_info;
+            uint32_t hi = serr->ee_data;
+            if (onRange)
+            {
+                onRange(lo, hi, serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+            }
+            while (!pending->empty() && static_cast<int32_t>(pending->front().id - hi) <= 0)
+            {
+                pending->pop_front();
+            }
+            reaped = true;
+        }
+    }
+    return reaped;
+}
+
+void ZeroCopyReaper::adopt(int fd, PendingQueue pending)
+{
+    reap(fd, &pending);
+    if (pending.empty())
+    {
+        return;
+    }
+
+    int dupFd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dupFd < 0)
+    {
+        LOG_ERROR("ZeroCopyReaper::adopt dup fd=%d error:%d, keep %zu payloads until loop exits\n", fd, errno, pending.size());
+        orphans_.push_back(std::move(pending));
+        return;
+    }
+    // 原fd关闭时socket还被dupFd引用 不会发FIN 这里替它关闭写端 已经断开时返回ENOTCONN 不用管
+    ::shutdown(dupFd, SHUT_WR);
+
+    std::unique_ptr<Drain> drain(new Drain());
+    drain->fd = dupFd;
+    drain->pending = std::move(pending);
+    drain->channel.reset(new Channel(loop_, dupFd));
+    // 完成通知以EPOLLERR报告 边沿触发下对端的数据和关闭只通知一次 不用读走
+    drain->channel->setReadCallback([this, dupFd](Timestamp) { handleEvent(dupFd); });
+    drain->channel->setCloseCallback([this, dupFd]() { handleEvent(dupFd); });
+    drain->channel->setErrorCallback([this, dupFd]() { handleEvent(dupFd); });
+    drain->channel->setEdgeTriggered(true);
+    drain->channel->enableReading(); // 注册时已经到达的通知也会报告
+    drains_[dupFd] = std::move(drain);
+}
+
+void ZeroCopyReaper::handleEvent(int fd)
+{
+    auto it = drains_.find(fd);
+    if (it == drains_.end() || it->second->finishing)
+    {
+        return;
+    }
+    Drain *drain = it->second.get();
+    reap(fd, &drain->pending);
+    if (drain->pending.empty())
+    {
+        // 一次事件可能依次调用几个回调 Channel在回调执行完后再销毁
+        drain->finishing = true;
+        loop_->queueInLoop([this, fd]() { finish(fd); });
+    }
+}
+
+void ZeroCopyReaper::finish(int fd)
+{
+    auto it = drains_.find(fd);
+    if (it == drains_.end())
+    {
+        return;
+    }
+    it->second->channel->disableAll();
+    it->second->channel->remove();
+    ::close(fd);
+    drains_.erase(it);
+}